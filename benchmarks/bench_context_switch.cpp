@@ -0,0 +1,56 @@
+// Times resume/yield round trips for the ZERO_FIBER_CONTEXT_PROFILE this
+// file is compiled with, see the bench_switch_* targets in CMakeLists.txt.
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cfenv>
+
+#define ZERO_FIBER_IMPL
+#include <zero/zero_fiber.h>
+
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_MINIMAL
+static const char *profile_name = "minimal";
+#elif ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+static const char *profile_name = "fpenv";
+#else
+static const char *profile_name = "abi";
+#endif
+
+static void *bench_ping(void *data) {
+    for(;;) zero_fiber_yield(data);
+    return nullptr;
+}
+
+// changes the rounding mode and leaves it changed while suspended
+static void *bench_round_up(void *data) {
+    fesetround(FE_UPWARD);
+    for(;;) zero_fiber_yield(data);
+    return nullptr;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+
+    zero_fiber_t *fiber = zero_fiber_make("bench_ping", 64*1024, bench_ping, nullptr);
+    for(int i = 0; i < 1000; i++) zero_fiber_resume(fiber, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < iterations; i++) {
+        zero_fiber_resume(fiber, nullptr);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    // every round trip is two switches, into the fiber and back out
+    printf("%-8s %ld round trips, %.2f ns per switch\n", profile_name, iterations, ns / (double)iterations / 2.0);
+
+    zero_fiber_t *rounding = zero_fiber_make("bench_round_up", 64*1024, bench_round_up, nullptr);
+    zero_fiber_resume(rounding, nullptr);
+    printf("%-8s rounding mode %s the fiber\n", profile_name,
+           fegetround() == FE_TONEAREST ? "stays inside" : "leaks out of");
+    fesetround(FE_TONEAREST);
+
+    zero_fiber_delete(rounding);
+    zero_fiber_delete(fiber);
+    return 0;
+}
@@ -0,0 +1,262 @@
+#ifndef ZERO_CORO_INCLUDED
+/*
+    zero_coro.h    -- C++20 coroutine tasks on top of zero_jobs.h
+
+    Project URL: https://github.com/zerotri/zero
+
+    Example:
+
+        job_task<int> load(int id) {
+            co_await job_sleep(0.1);
+            co_return id * 2;
+        }
+
+        job_task<> update(ZERO_ATOMIC(int) *batch) {
+            co_await job_until_zero(batch);
+            int value = co_await load(7);
+            ...
+        }
+
+        job_spawn(update(&batch), &done);
+
+    A coroutine task lives in a heap frame instead of a pooled fiber
+    stack, so it is the cheap choice for large numbers of short async
+    state machines. Tasks are driven by the same jobs_run as fibers:
+    each time a task is resumed it runs as a one-shot inline job record
+    (see job_create_inline), and every suspension that has to wait
+    parks such a record in the worker's wait queue. Fibers and tasks
+    meet through counters, a task can wait for fiber jobs created with
+    a counter and a fiber can job_wait_on_condition for tasks spawned
+    with one.
+
+    A task only runs on the worker that resumes it, a task waiting on a
+    counter carries on on the thread it suspended on. Tasks can't be
+    cancelled and can't call the fiber waits (job_wait and friends) or
+    job_yield, use the awaitables below instead.
+
+    job_task<T> task(...);
+        A coroutine returning job_task<T> starts suspended. co_await it
+        from another task to run it to completion on the awaiting
+        task's worker and get its co_return value, or hand a
+        job_task<void> to job_spawn.
+
+    void job_spawn(job_task<> task, ZERO_ATOMIC(int) *counter = NULL, job_affinity_t affinity = JOB_AFFINITY_ANY);
+        Queue [task] to start on the next jobs_run of [affinity]. The
+        task owns its frame from then on and frees it when it finishes.
+        [counter] is incremented now and decremented once the task has
+        finished. If the job pool is exhausted the task is started on
+        the calling thread right away.
+
+    co_await job_sleep(double seconds);
+    co_await job_until_zero(ZERO_ATOMIC(int) *counter, double timeout = JOB_WAIT_FOREVER);
+    co_await job_next_pass();
+        Resume after [seconds], once [counter] is zero or on the next
+        jobs_run. Each gives back JOB_WAIT_OK, or JOB_WAIT_TIMED_OUT if
+        [counter] was still non-zero after [timeout]. job_until_zero
+        with a counter that is already zero doesn't suspend.
+
+        Suspending takes a resume record from the inline pool, or from
+        the heap once the pool is exhausted (see job_alloc_heap), so
+        any number of tasks can be suspended at once. If not even the
+        heap has one the task carries on without suspending and the
+        wait gives back -1.
+
+    Only available when the compiler supports coroutines (C++20).
+*/
+
+#define ZERO_CORO_INCLUDED (1)
+
+#include "zero_jobs.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+template<typename T = void> struct job_task;
+
+// entrypoint of the inline records that resume a task
+inline void *job_coro_resume(void *address) {
+    std::coroutine_handle<>::from_address(address).resume();
+    return nullptr;
+}
+
+struct job_promise_base_t {
+    // task awaiting this one, resumed once it finishes
+    std::coroutine_handle<> continuation;
+    ZERO_ATOMIC(int) *counter = nullptr;
+    // spawned tasks free their own frame
+    bool detached = false;
+
+    struct final_awaiter_t {
+        bool await_ready() noexcept { return false; }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            job_promise_base_t &promise = handle.promise();
+            std::coroutine_handle<> next = promise.continuation ? promise.continuation : std::noop_coroutine();
+
+            if(promise.detached) {
+                ZERO_ATOMIC(int) *counter = promise.counter;
+                handle.destroy();
+                if(counter) {
+                    ZERO_ATOMIC_DECREMENT(counter);
+                }
+            }
+            return next;
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter_t final_suspend() noexcept { return {}; }
+    void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template<typename T>
+struct job_promise_t : job_promise_base_t {
+    std::optional<T> value;
+
+    job_task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+};
+
+template<>
+struct job_promise_t<void> : job_promise_base_t {
+    job_task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+};
+
+template<typename T>
+struct job_task {
+    typedef job_promise_t<T> promise_type;
+
+    std::coroutine_handle<promise_type> handle;
+
+    explicit job_task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    job_task(job_task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    job_task(const job_task&) = delete;
+    job_task &operator=(const job_task&) = delete;
+
+    ~job_task() {
+        if(handle) handle.destroy();
+    }
+
+    // awaiting a task runs it straight away, it hands control back to
+    // the awaiting task when it finishes
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    T await_resume() {
+        if constexpr (!std::is_void<T>::value) {
+            return std::move(*handle.promise().value);
+        }
+    }
+};
+
+template<typename T>
+job_task<T> job_promise_t<T>::get_return_object() noexcept {
+    return job_task<T>(std::coroutine_handle<job_promise_t<T>>::from_promise(*this));
+}
+
+inline job_task<void> job_promise_t<void>::get_return_object() noexcept {
+    return job_task<void>(std::coroutine_handle<job_promise_t<void>>::from_promise(*this));
+}
+
+inline void job_spawn(job_task<> task, ZERO_ATOMIC(int) *counter = NULL, job_affinity_t affinity = JOB_AFFINITY_ANY) {
+    std::coroutine_handle<job_promise_t<void>> handle = std::exchange(task.handle, nullptr);
+    handle.promise().detached = true;
+    handle.promise().counter = counter;
+    if(counter) {
+        ZERO_ATOMIC_INCREMENT(counter);
+    }
+
+    if(!job_create_inline(job_coro_resume, handle.address(), nullptr, affinity)) {
+        handle.resume();
+    }
+}
+
+// a record that resumes [handle], from the heap once the inline pool
+// is exhausted
+inline job_t *job_coro_record(std::coroutine_handle<> handle) {
+    job_t *record = job_alloc_inline(job_coro_resume, handle.address());
+    return record ? record : job_alloc_heap(job_coro_resume, handle.address());
+}
+
+// Parks a resume record for the awaiting task in the wait queue, the
+// same way job_park does for a fiber. The record is still alive while
+// the task runs await_resume, so the wait result is read from it.
+struct job_coro_wait_t {
+    int condition;
+    void *address;
+    double end_time;
+    job_t *record;
+    // no record could be had, the task didn't suspend
+    bool failed = false;
+
+    bool await_ready() const noexcept {
+        return condition == job_waiting_t::JOB_WAIT_COUNTER_ZERO &&
+               ZERO_ATOMIC_LOAD((ZERO_ATOMIC(int)*)address) == 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        record = job_coro_record(handle);
+        if(!record) {
+            failed = true;
+            return false;
+        }
+
+        job_waiting_t *wait = &record->wait;
+        wait->condition = (decltype(wait->condition))condition;
+        wait->data_address = address;
+        wait->end_time = end_time;
+        wait->cancellable = false;
+        waiting_jobs.push(record);
+        return true;
+    }
+
+    int await_resume() const noexcept {
+        return failed ? -1 : record ? record->wait_result : JOB_WAIT_OK;
+    }
+};
+
+struct job_coro_yield_t {
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        job_t *record = job_coro_record(handle);
+        if(!record) {
+            return false;
+        }
+        yielded_jobs.push(record);
+        return true;
+    }
+
+    int await_resume() const noexcept { return JOB_WAIT_OK; }
+};
+
+inline job_coro_wait_t job_sleep(double seconds) {
+    return { job_waiting_t::JOB_WAIT_TIMER, nullptr, latest_time + seconds, nullptr };
+}
+
+inline job_coro_wait_t job_until_zero(ZERO_ATOMIC(int) *counter, double timeout = JOB_WAIT_FOREVER) {
+    return { job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)counter,
+             timeout == JOB_WAIT_FOREVER ? JOB_WAIT_FOREVER : latest_time + timeout, nullptr };
+}
+
+inline job_coro_yield_t job_next_pass() {
+    return {};
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // ZERO_CORO_INCLUDED
@@ -47,9 +47,30 @@
     Optionally provide the following defines with your own implementations:
     ZERO_FIBER_ASSERT(c)     - your own assert macro (default: assert(c))
 
+    ZERO_FIBER_CONTEXT_PROFILE picks what the x86_64 context switch saves,
+    other targets ignore it:
+        ZERO_FIBER_CONTEXT_MINIMAL - integer callee-saved registers only. On
+            Windows this skips xmm6-xmm15, so fibers and the code resuming
+            them must not keep floating point values live across a switch.
+            On SystemV it is the same as ZERO_FIBER_CONTEXT_ABI.
+        ZERO_FIBER_CONTEXT_ABI     - every callee-saved register of the
+            platform ABI (default).
+        ZERO_FIBER_CONTEXT_FPENV   - ABI, plus MXCSR and the x87 control
+            word, so a fiber that changes rounding or denormal modes keeps
+            them to itself. New fibers start from the default environment.
+    Define it next to ZERO_FIBER_IMPL.
+
     struct zero_fiber_t *zero_fiber_make(const char* name, size_t stack_size, zero_entrypoint_t entrypoint);
     
     void zero_fiber_delete(struct zero_fiber_t *fiber);
+
+    struct zero_fiber_t *zero_fiber_make_in(void *memory, size_t size, const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data);
+        Build a fiber inside [size] bytes of caller-owned [memory], the
+        header at the start and the stack in the rest, for carving many
+        fibers out of one large allocation. [memory] must be 16-byte
+        aligned and outlive the fiber, zero_fiber_delete leaves it alone.
+        Returns NULL if [size] leaves less than ZERO_FIBER_MIN_STACK_SIZE
+        for the stack.
     
     struct zero_fiber_t *zero_fiber_active(void);
         Get the current fiber. If this is called outside of an active
@@ -61,6 +82,53 @@
     
     int zero_fiber_is_active(struct zero_fiber_t *fiber);
 
+    struct zero_fiber_t *zero_fiber_make_shared(const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data);
+        Create a fiber that runs on its thread's shared stack. When another
+        shared fiber takes the stack over, only the used part of this
+        fiber's stack is copied out to a buffer sized to fit it, and it is
+        copied back before the fiber next runs. Shared fibers must always
+        be resumed from a fiber with its own stack, and stay on the thread
+        they were first resumed on. On targets other than x86_64 this falls
+        back to a regular fiber of ZERO_FIBER_SHARED_FALLBACK_SIZE.
+
+    int zero_fiber_shared_stack_init(size_t size);
+        Set up the calling thread's shared stack. Optional, the first shared
+        fiber resumed on a thread allocates ZERO_FIBER_SHARED_STACK_SIZE.
+
+    void zero_fiber_reset(struct zero_fiber_t *fiber, zero_entrypoint_t entrypoint, zero_userdata_t data);
+        Rewind a fiber that isn't running so it starts [entrypoint] from
+        the top, reusing its stack.
+
+    struct zero_fiber_t *zero_fiber_running(void);
+        The fiber running on this thread, or NULL if none has been
+        switched to yet. Unlike zero_fiber_active this never derives a
+        fiber, so it is safe to call from a signal handler.
+
+    int zero_fiber_stack_bounds(struct zero_fiber_t *fiber, void **low, void **high);
+        Get the memory [fiber]'s stack lives in, for shared fibers the
+        thread's shared stack. Returns -1 for a thread's main fiber,
+        whose stack isn't owned by zero_fiber. Signal safe.
+
+    int zero_fiber_frame_walk(void *frame, void *low, void *high, void **frames, int max_frames);
+        Follow the frame pointer chain starting at [frame], writing up to
+        [max_frames] return addresses to [frames] and returning how many
+        were written. Only memory in [low, high) is read. Signal safe.
+
+    int zero_fiber_local_key(void);
+        Reserve one of the ZERO_FIBER_LOCAL_COUNT fiber-local slots every
+        fiber carries in its header, or -1 if all are taken. Keys are
+        never released, reserve them once at startup.
+
+    zero_userdata_t zero_fiber_local_get(int key);
+    void zero_fiber_local_set(int key, zero_userdata_t value);
+        Read or write the active fiber's slot for [key], an array index
+        into the fiber header. Slots start out NULL and are cleared by
+        zero_fiber_reset, nothing is freed for you.
+
+    The entry frame of every fiber has a 0 return address and a 0 frame
+    pointer, so unwinders and frame pointer walks stop at the fiber's
+    entrypoint instead of running off the top of its stack.
+
     ucoroutine_t uco_active(void);
         Get the current coroutine. If this is called outside of an active
         coroutine, it will derive one from the currently running thread.
@@ -133,6 +201,16 @@ typedef void *zero_userdata_t;
 typedef void *(*zero_entrypoint_t)(void*);
 typedef void (*zero_entrypoint_wrapper_t)();
 
+/* fiber-local slots in each fiber header, see zero_fiber_local_key */
+#if !defined(ZERO_FIBER_LOCAL_COUNT)
+    #define ZERO_FIBER_LOCAL_COUNT (8)
+#endif
+
+/* smallest stack zero_fiber_make_in accepts */
+#if !defined(ZERO_FIBER_MIN_STACK_SIZE)
+    #define ZERO_FIBER_MIN_STACK_SIZE (4 * 1024)
+#endif
+
 struct zero_fiber_t {
     struct zero_fiber_t *caller;
     const char* description;
@@ -141,16 +219,37 @@ struct zero_fiber_t {
     zero_entrypoint_t entrypoint;
     enum zero_coroutine_status status;
     size_t stack_size;
+    /* header and stack live in caller memory, see zero_fiber_make_in */
+    int external;
+
+    /* shared-stack fibers only, see zero_fiber_make_shared */
+    int shared;
+    char *shared_stack_top;
+    char *stack_copy;
+    size_t stack_copy_size;
+    size_t stack_copy_capacity;
+
+    zero_userdata_t locals[ZERO_FIBER_LOCAL_COUNT];
 };
 
 ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make(const char* name, size_t stack_size, zero_entrypoint_t entrypoint, zero_userdata_t data);
 ZERO_FIBER_API_DECL void zero_fiber_delete(struct zero_fiber_t *fiber);
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make_in(void *memory, size_t size, const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data);
 ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_active(void);
 ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_resume(struct zero_fiber_t *coroutine, zero_userdata_t userdata);
 ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_yield(zero_userdata_t userdata);
 ZERO_FIBER_API_DECL int zero_fiber_is_active(struct zero_fiber_t *fiber);
 ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_active_data();
 ZERO_FIBER_API_DECL zero_context_t zero_context_derive(void* memory, unsigned int size, zero_entrypoint_t entrypoint);
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make_shared(const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data);
+ZERO_FIBER_API_DECL int zero_fiber_shared_stack_init(size_t size);
+ZERO_FIBER_API_DECL void zero_fiber_reset(struct zero_fiber_t *fiber, zero_entrypoint_t entrypoint, zero_userdata_t data);
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_running(void);
+ZERO_FIBER_API_DECL int zero_fiber_stack_bounds(struct zero_fiber_t *fiber, void **low, void **high);
+ZERO_FIBER_API_DECL int zero_fiber_frame_walk(void *frame, void *low, void *high, void **frames, int max_frames);
+ZERO_FIBER_API_DECL int zero_fiber_local_key(void);
+ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_local_get(int key);
+ZERO_FIBER_API_DECL void zero_fiber_local_set(int key, zero_userdata_t value);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -159,7 +258,7 @@ ZERO_FIBER_API_DECL zero_context_t zero_context_derive(void* memory, unsigned in
 
 
 /*-- IMPLEMENTATION ----------------------------------------------------------*/
-#ifdef ZERO_FIBER_IMPL
+#if defined(ZERO_FIBER_IMPL) && !defined(ZERO_FIBER_IMPL_INCLUDED)
 #define ZERO_FIBER_IMPL_INCLUDED (1)
 
 #ifndef ZERO_FIBER_API_IMPL
@@ -170,6 +269,7 @@ ZERO_FIBER_API_DECL zero_context_t zero_context_derive(void* memory, unsigned in
     #include <stdlib.h>
 #endif
 #if !defined(ZERO_FIBER_ASSERT)
+    #include <assert.h>
     #define ZERO_FIBER_ASSERT(str) assert(str)
 #endif
 #if !defined(ZERO_FIBER_MALLOC)
@@ -178,6 +278,27 @@ ZERO_FIBER_API_DECL zero_context_t zero_context_derive(void* memory, unsigned in
 #if !defined(ZERO_FIBER_FREE)
     #define ZERO_FIBER_FREE(ptr) free(ptr)
 #endif
+#if !defined(ZERO_FIBER_REALLOC)
+    #define ZERO_FIBER_REALLOC(ptr, size) realloc(ptr, size)
+#endif
+#if !defined(ZERO_FIBER_SHARED_STACK_SIZE)
+    #define ZERO_FIBER_SHARED_STACK_SIZE (256*1024)
+#endif
+#if !defined(ZERO_FIBER_SHARED_FALLBACK_SIZE)
+    #define ZERO_FIBER_SHARED_FALLBACK_SIZE (64*1024)
+#endif
+/* registers saved by _zero_co_swap_function, see ZERO_FIBER_CONTEXT_PROFILE */
+#define ZERO_FIBER_CONTEXT_MINIMAL (0)
+#define ZERO_FIBER_CONTEXT_ABI     (1)
+#define ZERO_FIBER_CONTEXT_FPENV   (2)
+#if !defined(ZERO_FIBER_CONTEXT_PROFILE)
+    #define ZERO_FIBER_CONTEXT_PROFILE ZERO_FIBER_CONTEXT_ABI
+#endif
+/* room for the register file a context switch saves, see _zero_co_swap_function */
+#if !defined(ZERO_FIBER_CONTEXT_SIZE)
+    #define ZERO_FIBER_CONTEXT_SIZE (256)
+#endif
+#include <string.h>
 
 #ifndef _ZERO_FIBER_PRIVATE
     #if defined(__GNUC__) || defined(__clang__)
@@ -239,6 +360,11 @@ static const unsigned char _zero_co_swap_function[4096] = {
     0x4c, 0x89, 0x6a, 0x30,        /* mov [rdx+48],r13       */
     0x4c, 0x89, 0x72, 0x38,        /* mov [rdx+56],r14       */
     0x4c, 0x89, 0x7a, 0x40,        /* mov [rdx+64],r15       */
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+    0x0f, 0xae, 0x5a, 0x48,        /* stmxcsr [rdx+72]       */
+    0xd9, 0x7a, 0x4c,              /* fnstcw [rdx+76]        */
+#endif
+#if ZERO_FIBER_CONTEXT_PROFILE != ZERO_FIBER_CONTEXT_MINIMAL
     0x0f, 0x29, 0x72, 0x50,        /* movaps [rdx+ 80],xmm6  */
     0x0f, 0x29, 0x7a, 0x60,        /* movaps [rdx+ 96],xmm7  */
     0x44, 0x0f, 0x29, 0x42, 0x70,  /* movaps [rdx+112],xmm8  */
@@ -250,6 +376,7 @@ static const unsigned char _zero_co_swap_function[4096] = {
     0x44, 0x0f, 0x29, 0x6a, 0x50,  /* movaps [rdx+ 80],xmm13 */
     0x44, 0x0f, 0x29, 0x72, 0x60,  /* movaps [rdx+ 96],xmm14 */
     0x44, 0x0f, 0x29, 0x7a, 0x70,  /* movaps [rdx+112],xmm15 */
+#endif
     0x48, 0x8b, 0x69, 0x08,        /* mov rbp,[rcx+ 8]       */
     0x48, 0x8b, 0x71, 0x10,        /* mov rsi,[rcx+16]       */
     0x48, 0x8b, 0x79, 0x18,        /* mov rdi,[rcx+24]       */
@@ -258,6 +385,11 @@ static const unsigned char _zero_co_swap_function[4096] = {
     0x4c, 0x8b, 0x69, 0x30,        /* mov r13,[rcx+48]       */
     0x4c, 0x8b, 0x71, 0x38,        /* mov r14,[rcx+56]       */
     0x4c, 0x8b, 0x79, 0x40,        /* mov r15,[rcx+64]       */
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+    0x0f, 0xae, 0x51, 0x48,        /* ldmxcsr [rcx+72]       */
+    0xd9, 0x69, 0x4c,              /* fldcw [rcx+76]         */
+#endif
+#if ZERO_FIBER_CONTEXT_PROFILE != ZERO_FIBER_CONTEXT_MINIMAL
     0x0f, 0x28, 0x71, 0x50,        /* movaps xmm6, [rcx+ 80] */
     0x0f, 0x28, 0x79, 0x60,        /* movaps xmm7, [rcx+ 96] */
     0x44, 0x0f, 0x28, 0x41, 0x70,  /* movaps xmm8, [rcx+112] */
@@ -269,6 +401,7 @@ static const unsigned char _zero_co_swap_function[4096] = {
     0x44, 0x0f, 0x28, 0x69, 0x50,  /* movaps xmm13,[rcx+ 80] */
     0x44, 0x0f, 0x28, 0x71, 0x60,  /* movaps xmm14,[rcx+ 96] */
     0x44, 0x0f, 0x28, 0x79, 0x70,  /* movaps xmm15,[rcx+112] */
+#endif
     0xff, 0xe0,                    /* jmp rax                */
 };
 
@@ -287,12 +420,20 @@ static const unsigned char _zero_co_swap_function[4096] = {
     0x4c, 0x89, 0x6e, 0x20,  /* mov [rsi+32],r13 */
     0x4c, 0x89, 0x76, 0x28,  /* mov [rsi+40],r14 */
     0x4c, 0x89, 0x7e, 0x30,  /* mov [rsi+48],r15 */
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+    0x0f, 0xae, 0x5e, 0x38,  /* stmxcsr [rsi+56] */
+    0xd9, 0x7e, 0x3c,        /* fnstcw [rsi+60]  */
+#endif
     0x48, 0x8b, 0x6f, 0x08,  /* mov rbp,[rdi+ 8] */
     0x48, 0x8b, 0x5f, 0x10,  /* mov rbx,[rdi+16] */
     0x4c, 0x8b, 0x67, 0x18,  /* mov r12,[rdi+24] */
     0x4c, 0x8b, 0x6f, 0x20,  /* mov r13,[rdi+32] */
     0x4c, 0x8b, 0x77, 0x28,  /* mov r14,[rdi+40] */
     0x4c, 0x8b, 0x7f, 0x30,  /* mov r15,[rdi+48] */
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+    0x0f, 0xae, 0x57, 0x38,  /* ldmxcsr [rdi+56] */
+    0xd9, 0x6f, 0x3c,        /* fldcw [rdi+60]   */
+#endif
     0xff, 0xe0,              /* jmp rax          */
 };
 
@@ -318,6 +459,22 @@ _ZERO_FIBER_PRIVATE zero_context_t _zero_co_x86_64_active(void) {
     return zero_active_context;
 }
 
+/* a new context starts from the default floating point environment
+   rather than whatever the restored slots happen to hold */
+_ZERO_FIBER_PRIVATE void _zero_co_x86_64_init_fpenv(zero_context_t context) {
+#if ZERO_FIBER_CONTEXT_PROFILE == ZERO_FIBER_CONTEXT_FPENV
+    #if defined(ZERO_FIBER_WINDOWS)
+        unsigned int *fpenv = (unsigned int*)((char*)context + 72);
+    #else
+        unsigned int *fpenv = (unsigned int*)((char*)context + 56);
+    #endif
+    fpenv[0] = 0x1f80;  /* MXCSR: exceptions masked, round to nearest */
+    fpenv[1] = 0x037f;  /* x87 control word: exceptions masked, 64-bit precision, round to nearest */
+#else
+    (void)context;
+#endif
+}
+
 _ZERO_FIBER_PRIVATE zero_context_t _zero_co_x86_64_derive(void* memory, unsigned int size, zero_entrypoint_t entrypoint) {
     zero_context_t context;
     if(!_zero_co_swap) {
@@ -329,8 +486,11 @@ _ZERO_FIBER_PRIVATE zero_context_t _zero_co_x86_64_derive(void* memory, unsigned
     if((context = (zero_context_t)memory)) {
         unsigned int offset = (size & ~15) - 32;
         long long *p = (long long*)((char*)context + offset);  /* seek to top of stack */
+        *--p = 0;                                              /* return address of the entry frame, 0 ends unwinding */
         *--p = (long long)zero_fiber_wrap_entrypoint;                         /* start of function */
         *(long long*)context = (long long)p;                   /* stack pointer */
+        ((long long*)context)[1] = 0;                          /* rbp, ends frame pointer chains */
+        _zero_co_x86_64_init_fpenv(context);
     }
 
     return context;
@@ -671,10 +831,179 @@ ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make(const char* name, size_
     fiber->userdata = data;
     fiber->description = name;
     fiber->context = zero_context_create(stack_size, entrypoint);
+    fiber->external = 0;
+    fiber->shared = 0;
+    fiber->shared_stack_top = NULL;
+    fiber->stack_copy = NULL;
+    fiber->stack_copy_size = 0;
+    fiber->stack_copy_capacity = 0;
+    memset(fiber->locals, 0, sizeof(fiber->locals));
 
     return fiber;
 }
 
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make_in(void *memory, size_t size, const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    /* the stack starts on the first 64-byte boundary past the header */
+    size_t header_size = (sizeof(struct zero_fiber_t) + 63) & ~(size_t)63;
+    if(!memory || size < header_size + ZERO_FIBER_MIN_STACK_SIZE) return (struct zero_fiber_t*)NULL;
+
+    struct zero_fiber_t* fiber = (struct zero_fiber_t*) memory;
+    fiber->stack_size = size - header_size;
+    fiber->context = zero_context_derive((char*)memory + header_size, (unsigned int)fiber->stack_size, entrypoint);
+    fiber->entrypoint = entrypoint;
+    fiber->status = ZERO_FIBER_STARTED;
+    fiber->userdata = data;
+    fiber->description = name;
+    fiber->external = 1;
+    fiber->shared = 0;
+    fiber->shared_stack_top = NULL;
+    fiber->stack_copy = NULL;
+    fiber->stack_copy_size = 0;
+    fiber->stack_copy_capacity = 0;
+    memset(fiber->locals, 0, sizeof(fiber->locals));
+
+    return fiber;
+}
+
+static ZERO_FIBER_THREAD_LOCAL char *zero_fiber_shared_stack = NULL;
+static ZERO_FIBER_THREAD_LOCAL char *zero_fiber_shared_stack_top = NULL;
+static ZERO_FIBER_THREAD_LOCAL struct zero_fiber_t *zero_fiber_shared_owner = NULL;
+
+ZERO_FIBER_API_DECL int zero_fiber_shared_stack_init(size_t size) {
+    if(zero_fiber_shared_stack) {
+        return zero_fiber_shared_owner ? -1 : 0;
+    }
+
+    zero_fiber_shared_stack = (char*) ZERO_FIBER_MALLOC(size);
+    if(!zero_fiber_shared_stack) return -1;
+
+    /* same top-of-stack rounding as the private stacks in _zero_co_x86_64_derive */
+    zero_fiber_shared_stack_top = (char*)(((uintptr_t)zero_fiber_shared_stack + size) & ~(uintptr_t)15) - 32;
+    return 0;
+}
+
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_make_shared(const char* name, zero_entrypoint_t entrypoint, zero_userdata_t data) {
+#if defined(ZERO_FIBER_X86_64)
+    /* the header is followed by the 16-byte aligned register file */
+    struct zero_fiber_t* fiber = (struct zero_fiber_t*) ZERO_FIBER_MALLOC(sizeof(struct zero_fiber_t) + 15 + ZERO_FIBER_CONTEXT_SIZE);
+    if(!fiber) return (struct zero_fiber_t*)NULL;
+
+    if(!_zero_co_swap) {
+        _zero_co_x86_64_init();
+        _zero_co_swap = (void *(*)(zero_context_t, zero_context_t))(void*)_zero_co_swap_function;
+    }
+    if(!zero_active_context) zero_active_context = &zero_context_active_buffer;
+
+    fiber->context = (zero_context_t)(((uintptr_t)(fiber + 1) + 15) & ~(uintptr_t)15);
+    fiber->description = name;
+    fiber->stack_size = 0;
+    fiber->external = 0;
+    fiber->shared = 1;
+    fiber->stack_copy = NULL;
+    fiber->stack_copy_capacity = 0;
+    zero_fiber_reset(fiber, entrypoint, data);
+
+    return fiber;
+#else
+    return zero_fiber_make(name, ZERO_FIBER_SHARED_FALLBACK_SIZE, entrypoint, data);
+#endif
+}
+
+ZERO_FIBER_API_DECL void zero_fiber_reset(struct zero_fiber_t *fiber, zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    if(fiber->shared) {
+        /* the initial frame is laid out on the shared stack at first resume */
+        if(zero_fiber_shared_owner == fiber) zero_fiber_shared_owner = NULL;
+        fiber->shared_stack_top = NULL;
+        fiber->stack_copy_size = 0;
+    }
+    else {
+        zero_context_derive(fiber->context, fiber->stack_size, entrypoint);
+    }
+
+    fiber->entrypoint = entrypoint;
+    fiber->userdata = data;
+    fiber->status = ZERO_FIBER_STARTED;
+    memset(fiber->locals, 0, sizeof(fiber->locals));
+}
+
+static long zero_fiber_local_keys = 0;
+
+ZERO_FIBER_API_DECL int zero_fiber_local_key(void) {
+#if defined(_MSC_VER)
+    long key = InterlockedExchangeAdd(&zero_fiber_local_keys, 1);
+#else
+    long key = __sync_fetch_and_add(&zero_fiber_local_keys, 1);
+#endif
+    return key < ZERO_FIBER_LOCAL_COUNT ? (int)key : -1;
+}
+
+ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_local_get(int key) {
+    ZERO_FIBER_ASSERT(key >= 0 && key < ZERO_FIBER_LOCAL_COUNT);
+    return zero_fiber_active()->locals[key];
+}
+
+ZERO_FIBER_API_DECL void zero_fiber_local_set(int key, zero_userdata_t value) {
+    ZERO_FIBER_ASSERT(key >= 0 && key < ZERO_FIBER_LOCAL_COUNT);
+    zero_fiber_active()->locals[key] = value;
+}
+
+#if defined(ZERO_FIBER_X86_64)
+/* copies the live part of the owner's stack, [saved rsp, top), out of the shared stack */
+_ZERO_FIBER_PRIVATE int zero_fiber_shared_evict(struct zero_fiber_t *fiber) {
+    char *sp = *(char**)fiber->context;
+    size_t used = (size_t)(fiber->shared_stack_top - sp);
+
+    if(used > fiber->stack_copy_capacity) {
+        char *copy = (char*) ZERO_FIBER_REALLOC(fiber->stack_copy, used);
+        if(!copy) return -1;
+        fiber->stack_copy = copy;
+        fiber->stack_copy_capacity = used;
+    }
+
+    memcpy(fiber->stack_copy, sp, used);
+    fiber->stack_copy_size = used;
+    return 0;
+}
+
+/* puts [fiber]'s stack back onto the shared stack so it can be switched to */
+_ZERO_FIBER_PRIVATE int zero_fiber_shared_enter(struct zero_fiber_t *fiber) {
+    if(!zero_fiber_shared_stack && zero_fiber_shared_stack_init(ZERO_FIBER_SHARED_STACK_SIZE) != 0) {
+        return -1;
+    }
+
+    /* the owner is only still here if it lives on this thread's stack, a
+       pooled fiber that was reset and reused on another thread since has
+       a shared_stack_top of NULL or of that thread's stack */
+    struct zero_fiber_t *owner = zero_fiber_shared_owner;
+    int resident = owner && owner->shared_stack_top == zero_fiber_shared_stack_top;
+    if(owner == fiber && resident) {
+        return 0;
+    }
+
+    if(resident && owner->status != ZERO_FIBER_ENDED && zero_fiber_shared_evict(owner) != 0) {
+        return -1;
+    }
+    zero_fiber_shared_owner = fiber;
+
+    if(!fiber->shared_stack_top) {
+        long long *p = (long long*)zero_fiber_shared_stack_top;
+        *--p = 0;                                        /* return address of the entry frame, 0 ends unwinding */
+        *--p = (long long)zero_fiber_wrap_entrypoint;    /* start of function */
+        ((long long*)fiber->context)[0] = (long long)p;  /* stack pointer */
+        ((long long*)fiber->context)[1] = 0;             /* rbp, ends frame pointer chains */
+        _zero_co_x86_64_init_fpenv(fiber->context);
+        fiber->shared_stack_top = zero_fiber_shared_stack_top;
+        return 0;
+    }
+
+    /* stack contents hold absolute addresses, a fiber can't move to another thread's stack */
+    ZERO_FIBER_ASSERT(fiber->shared_stack_top == zero_fiber_shared_stack_top);
+
+    memcpy(fiber->shared_stack_top - fiber->stack_copy_size, fiber->stack_copy, fiber->stack_copy_size);
+    return 0;
+}
+#endif
+
 ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_active_data() {
     struct zero_fiber_t *current_fiber = zero_fiber_active();
 
@@ -697,6 +1026,16 @@ ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_resume(struct zero_fiber_t *corou
     printf("  to %s\n", coroutine->description);
 #endif
 
+#if defined(ZERO_FIBER_X86_64)
+    if(coroutine->shared) {
+        /* resuming from the shared stack would overwrite the caller's own frames */
+        ZERO_FIBER_ASSERT(!current_fiber->shared);
+        if(zero_fiber_shared_enter(coroutine) != 0) {
+            return NULL;
+        }
+    }
+#endif
+
 	coroutine->caller = current_fiber;
     coroutine->caller->status = ZERO_FIBER_SUSPENDED;
     coroutine->userdata = userdata;
@@ -761,8 +1100,59 @@ ZERO_FIBER_API_DECL zero_userdata_t zero_fiber_yield(zero_userdata_t userdata) {
     return returndata;
 }
 
+ZERO_FIBER_API_DECL struct zero_fiber_t *zero_fiber_running(void) {
+    return zero_fiber_current;
+}
+
+ZERO_FIBER_API_DECL int zero_fiber_stack_bounds(struct zero_fiber_t *fiber, void **low, void **high) {
+    if(!fiber || fiber == &zero_fiber_main) {
+        return -1;
+    }
+
+    if(fiber->shared) {
+        if(!zero_fiber_shared_stack) return -1;
+        *low = zero_fiber_shared_stack;
+        *high = zero_fiber_shared_stack_top + 32;
+    }
+    else {
+        *low = fiber->context;
+        *high = (char*)fiber->context + fiber->stack_size;
+    }
+    return 0;
+}
+
+ZERO_FIBER_API_DECL int zero_fiber_frame_walk(void *frame, void *low, void *high, void **frames, int max_frames) {
+    char *at = (char*)frame;
+    int depth = 0;
+
+    /* every frame is [saved frame pointer][return address], stop at the
+       0 the fiber entry frame ends with or once the chain leaves the stack */
+    while(depth < max_frames && at >= (char*)low && at + 2 * sizeof(void*) <= (char*)high &&
+          ((uintptr_t)at & (sizeof(void*) - 1)) == 0) {
+        void *return_address = ((void**)at)[1];
+        if(!return_address) break;
+
+        frames[depth++] = return_address;
+
+        char *next = ((char**)at)[0];
+        if(next <= at) break;
+        at = next;
+    }
+
+    return depth;
+}
+
 ZERO_FIBER_API_DECL void zero_fiber_delete(struct zero_fiber_t *fiber) {
-    zero_context_delete(fiber->context);
+    if(fiber->shared) {
+        if(zero_fiber_shared_owner == fiber) zero_fiber_shared_owner = NULL;
+        ZERO_FIBER_FREE(fiber->stack_copy);
+    }
+    else if(fiber->external) {
+        return;
+    }
+    else {
+        zero_context_delete(fiber->context);
+    }
     ZERO_FIBER_FREE(fiber);
 }
 
@@ -1,5 +1,29 @@
+#ifndef ZERO_JOBS_INCLUDED
+/*
+    zero_jobs.h    -- fiber based job scheduler
+
+    Project URL: https://github.com/zerotri/zero
+
+    Do this:
+        #define ZERO_JOBS_IMPL
+    before you include this file in *one* C++ file to create the
+    implementation.
+*/
+
+#define ZERO_JOBS_INCLUDED (1)
 #include <stdio.h>
-#include <queue>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef ZERO_JOBS_ASSERT
+#include <assert.h>
+#define ZERO_JOBS_ASSERT(c) assert(c)
+#endif
 
 #ifndef ZERO_JOBS_MALLOC
 #define ZERO_JOBS_MALLOC(x) malloc(x)
@@ -13,11 +37,26 @@
 #define ZERO_JOBS_REALLOC(x, y) realloc(x, y)
 #endif
 
+#ifndef ZERO_JOBS_PREFETCH
+#if defined(__GNUC__) || defined(__clang__)
+#define ZERO_JOBS_PREFETCH(p) __builtin_prefetch((const void*)(p))
+#else
+#define ZERO_JOBS_PREFETCH(p) ((void)(p))
+#endif
+#endif
+
 #include "zero_fiber.h"
 
 #define ZERO_ATOMIC_IMPL
 #include "zero_atomic.h"
 
+#if ZERO_ATOMIC_WINDOWS
+#include <windows.h>
+#elif ZERO_ATOMIC_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 // -- template --
 // #ifndef ZERO_JOBS_
 // #define ZERO_JOBS_
@@ -31,6 +70,17 @@
 #define ZERO_JOBS_LARGE_COUNT (32)
 #endif
 
+// inline jobs have no fiber, so these slots are just the job record
+#ifndef ZERO_JOBS_INLINE_COUNT
+#define ZERO_JOBS_INLINE_COUNT (1024)
+#endif
+
+// shared-stack jobs only hold a fiber header, their stacks are copied
+// out of the worker's shared stack to fit when they are switched away
+#ifndef ZERO_JOBS_SHARED_COUNT
+#define ZERO_JOBS_SHARED_COUNT (1024)
+#endif
+
 #ifndef ZERO_JOBS_SMALL_SIZE
 #define ZERO_JOBS_SMALL_SIZE (64*1024)
 #endif
@@ -39,346 +89,3370 @@
 #define ZERO_JOBS_LARGE_SIZE (512*1024)
 #endif
 
+// most chunks of ZERO_JOBS_*_COUNT jobs a pool grows to, see
+// jobs_config_t::pool_limits
+#ifndef ZERO_JOBS_POOL_MAX_CHUNKS
+#define ZERO_JOBS_POOL_MAX_CHUNKS (16)
+#endif
+
+// page size the stack slabs are rounded to and aligned on, see
+// jobs_config_t::huge_page_stacks
+#ifndef ZERO_JOBS_HUGE_PAGE_SIZE
+#define ZERO_JOBS_HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+
 #ifndef ZERO_JOBS_TIMING_ERROR
 #define ZERO_JOBS_TIMING_ERROR (0.000001)
 #endif
 
+// size of the blocks each worker's frame arenas grow by
+#ifndef ZERO_JOBS_ARENA_SIZE
+#define ZERO_JOBS_ARENA_SIZE (256*1024)
+#endif
+
+// frames an arena allocation survives, 2 lets data made during one
+// frame be read throughout the next
+#ifndef ZERO_JOBS_ARENA_FRAMES
+#define ZERO_JOBS_ARENA_FRAMES (2)
+#endif
+
+// distinct entrypoints/descriptions jobs_perf_enable keeps counters for
+#ifndef ZERO_JOBS_PERF_ENTRIES
+#define ZERO_JOBS_PERF_ENTRIES (256)
+#endif
+
+// frames of a stalled job's stack the watchdog captures
+#ifndef ZERO_JOBS_WATCHDOG_DEPTH
+#define ZERO_JOBS_WATCHDOG_DEPTH (32)
+#endif
+
+// sent to a worker to capture the stack of a stalled job, SIGURG is
+// ignored by default so a stray one is harmless
+#ifndef ZERO_JOBS_WATCHDOG_SIGNAL
+#define ZERO_JOBS_WATCHDOG_SIGNAL SIGURG
+#endif
+
+// longest jobs_run_until_idle sleeps while a job waits on a counter or
+// address, which can change without anyone calling jobs_wake
+#ifndef ZERO_JOBS_IDLE_POLL_NS
+#define ZERO_JOBS_IDLE_POLL_NS (1000000)
+#endif
+
+// frames a job_pipeline_t can keep in flight at most
+#ifndef ZERO_JOBS_PIPELINE_FRAMES
+#define ZERO_JOBS_PIPELINE_FRAMES (4)
+#endif
+
+// stages each pipelined frame is split into
+#ifndef ZERO_JOBS_PIPELINE_STAGES
+#define ZERO_JOBS_PIPELINE_STAGES (8)
+#endif
+
+// slots each of a worker's job rings is reserved with, they grow past
+// it when needed
+#ifndef ZERO_JOBS_QUEUE_SIZE
+#define ZERO_JOBS_QUEUE_SIZE (1024)
+#endif
+
+// threads job_run_blocking runs calls on at most, started on demand
+#ifndef ZERO_JOBS_BLOCKING_THREADS
+#define ZERO_JOBS_BLOCKING_THREADS (4)
+#endif
+
+// closures passed to job_create up to this size are stored in the job
+// record itself, larger ones are allocated with ZERO_JOBS_MALLOC
+#ifndef ZERO_JOBS_CAPTURE_SIZE
+#define ZERO_JOBS_CAPTURE_SIZE (64)
+#endif
+
+// worker 0 is always the main thread (the one calling job_pool_init)
+// this can't exceed 31, bit 31 of an affinity mask is JOB_AFFINITY_PREFER
+#ifndef ZERO_JOBS_MAX_WORKERS
+#define ZERO_JOBS_MAX_WORKERS (16)
+#endif
+
 void *basic_job(void *data);
 
+// Affinity masks: bit k allows the job to run on worker k. An empty
+// mask runs the job wherever it was created. Masks are hard by
+// default; jobs are only ever handed to an allowed worker and are
+// never moved off it. OR in JOB_AFFINITY_PREFER to make the mask a
+// hint, in which case the job stays local if none of the workers it
+// names have entered the scheduler.
+typedef uint32_t job_affinity_t;
+#define JOB_AFFINITY_ANY (0u)
+#define JOB_AFFINITY_MAIN (1u << 0)
+#define JOB_AFFINITY_WORKER(k) (1u << (k))
+#define JOB_AFFINITY_PREFER (1u << 31)
 
-struct job_t {
-    struct zero_fiber_t* fiber;
-    ZERO_ATOMIC(int) *status_counter;
+// what a suspended job is resumed with, returned from the job_wait*
+// and job_yield calls
+enum job_wait_result_t {
+    JOB_WAIT_OK = 0,
+    JOB_WAIT_TIMED_OUT,
+    JOB_WAIT_CANCELLED
 };
 
-struct job_waiting_t {
-    job_t job;
+#define JOB_WAIT_FOREVER (-1.0)
+
+// readiness job_wait_fd waits for
+#define JOB_IO_READ  (1 << 0)
+#define JOB_IO_WRITE (1 << 1)
 
+struct job_group_t;
+
+// the pool a job record was taken from and goes back to
+enum job_pool_kind_t {
+    JOB_POOL_SMALL,
+    JOB_POOL_LARGE,
+    JOB_POOL_INLINE,
+    JOB_POOL_SHARED,
+    // inline records malloc'd one at a time, see job_alloc_heap
+    JOB_POOL_HEAP
+};
+
+// what a pool's fiber stacks were allocated from
+enum job_stack_backing_t {
+    JOB_STACKS_MALLOC,
+    JOB_STACKS_HUGETLB,
+    JOB_STACKS_THP,
+    // the pool grew chunks that got different ones
+    JOB_STACKS_MIXED
+};
+
+// what a job parked in [waiting_jobs] is waiting for, kept in the
+// job record itself
+struct job_waiting_t {
     enum {
         JOB_WAIT_TIMER,
         JOB_WAIT_COUNTER_ZERO,
-        JOB_WAIT_DATA_ZERO
+        JOB_WAIT_DATA_ZERO,
+        // data_address is the job's io_pending, see job_wait_fd
+        JOB_WAIT_FD
     } condition;
 
-    union {
-        double end_time;
-        void* data_address;
-    };
+    // deadline for JOB_WAIT_TIMER, timeout for the other conditions
+    // or JOB_WAIT_FOREVER
+    double end_time;
+    void* data_address;
+    bool cancellable;
 };
 
-thread_local std::queue<job_t> jobs;
-thread_local std::queue<job_t> yielded_jobs;
-thread_local std::queue<job_waiting_t> waiting_jobs;
-thread_local struct job_t *job_current = nullptr;
-thread_local double latest_time = 0.0;
+// Jobs are records in the job pool, queued by pointer so that a
+// job_t* returned from job_create stays a handle to the job until it
+// finishes and its slot is reclaimed. [fiber] is NULL for inline jobs,
+// which run to completion directly on the scheduler's stack and can't
+// yield or wait.
+struct job_t {
+    struct zero_fiber_t* fiber;
+    zero_entrypoint_t entrypoint;
+    enum job_pool_kind_t pool;
+    ZERO_ATOMIC(int) *status_counter;
+    job_affinity_t affinity;
+    zero_userdata_t data;
+    ZERO_ATOMIC(int) cancelled;
+    job_waiting_t wait;
+    int wait_result;
+    struct job_group_t *group;
+    const char *description;
+    uint32_t resumes;
+    // destroys the closure [data] points at once the job is freed
+    void (*capture_destroy)(void*);
+    alignas(16) unsigned char capture[ZERO_JOBS_CAPTURE_SIZE];
+    // the malloc'd block holding a closure too large for [capture]
+    void *capture_block;
+    // what the entrypoint returned, kept while a handle holds the job
+    zero_userdata_t result;
+    ZERO_ATOMIC(int) handle_state;
+    // bumped each time the slot is freed
+    ZERO_ATOMIC(int) generation;
+    // set while parked in job_wait_fd, cleared when epoll reports the fd
+    volatile int io_pending;
+    // the fiber's stack pages were handed back by job_pool_trim
+    int stack_trimmed;
+    // what the fiber's stack was allocated from
+    enum job_stack_backing_t stack_backing;
+};
 
-job_t *zero_jobs_small_pool = NULL;
-job_t *zero_jobs_large_pool = NULL;
+// A job that keeps its slot and result until job_await or job_release.
+// Slots are reused, [generation] tells a stale handle from the slot's
+// next job.
+struct job_handle_t {
+    job_t *job;
+    int generation;
+};
 
-ZERO_ATOMIC(job_t*) *zero_jobs_small_free_table = NULL;
-ZERO_ATOMIC(job_t*) *zero_jobs_large_free_table = NULL;
+template<typename T>
+struct job_future_t {
+    job_handle_t handle;
+};
 
-// [jobs_run] should take a floating point number for the current
-// time it should pull the jobs in [jobs] as well as any available
-// to run in [waiting_jobs], remove them from their queues and place
-// them into a temporary queue. The jobs in this temporary queue are
-// then run as fibers, where they can be placed back into the main
-// [jobs] queue or the [waiting_jobs] queue if their execution is
-// dependent on a fulfilled condition.
-//
-// Bonus: jobs/waiting_jobs should be made into thread-safe queues
-// whereby any thread can pull from them and any thread can place
-// new jobs into them. Jobs should be exchangeable between threads.
-// 
-// This could potentially be done by using multiple spsc queues for
-// every thread and using those for communication between the job
-// scheduler and individual thread execution units. An idea to try.
-// This has the potential for job execution order to get out of
-// sync, so we can add timestamps to them at enqueue and sort by
-// timestamp before execution to prevent that.
-//
-// 2/26/21: my current thought for the queuing mechanism is this:
-// main thread allocates a large array(1024? 2048?) of a job_alloc_t.
-// job_desc_t contains two members:
-//  - atomic_int owning_thread;
-//  - job_t job
-// when any thread wants to allocate a new job, they must loop
-// through the array to claim indices by atomic CAS on owning_thread
-// only when owning_thread == 0
-// 
-// when a thread wishes to free a job, they write zero to the
-// owning_thread field.
-//
-// the main thread also allocates a large array (4096?) of job_t* that
-// exists to contain any available jobs. To push a job, the main
-// thread first tries to grab a job_alloc_t from the allocation table.
-// Once an allocation is available, the main thread loops through
-// the available jobs array searching for the next index with a
-// nullptr. An atomic CAS should be performed to write a modified
-// form of the pointer to the found job_alloc_t.
-//
-// a secondary thread in idle execution state is just looping through
-// the available jobs array, trying to snatch up the first non-nullptr
-// found, at which point the job on the other end belongs to it.
-//
-// a similar array exists, owned by the main thread, for placing jobs
-// that are either new or waiting. The same approach is taken with a
-// secondary thread preparing any data into an allocation block and
-// swapping the pointer to that allocation block onto the array at the
-// first nullptr found.
-//
-// the main thread loops through the 'pushed_jobs' array regularly to
-// pull jobs into a 'pending_jobs' queue, or if a job is ready to be
-// run it can be immediately placed onto the 'available_jobs' queue.
-//
-// when any job has completed, the owning thread needs to find a slot
-// in the job_alloc_t table to place it back, ensuring data isn't
-// leaking and that further jobs can be allocated.
-//
-// These job arrays have the following operations:
-//
-// - T* try_take([optional] max_iterations)
-//   tries to take the first available object using CAS
-//   returns nullptr on failure
-//
-// - bool try_give(T* , [optional] max_iterations)
-//   tries to give an object back into the first available nullptr slot
-//   returns false on failure
-//
-// TODO(Wynter): We aren't currently cleaning up job memory. We
-// should check to see if a job has finished executing and
-// potentially free it.
-//
-// TODO(Wynter): In association with job memory free'ing, we can
-// also pool job memory allocations, which would allow us to reuse
-// the chunks instead of having to constantly malloc/free, which
-// could become very costly very quickly.
-void jobs_run(double time) {
-    latest_time = time;
-    std::queue<job_t> running_jobs;
+// A fork/join scope. Groups are plain structs meant to live on the
+// stack of the job that owns them, so a fork/join costs no heap
+// allocation. Cancelling a group, or the job that owns it, cancels
+// every job in it and in any group those jobs own in turn.
+struct job_group_t {
+    ZERO_ATOMIC(int) pending;
+    ZERO_ATOMIC(int) cancelled;
+    job_t *owner;
+};
 
-    bool run_queueing = true;
+struct jobs_config_t {
+    int worker_count;
+    // core to pin each worker to when it enters, or -1 to leave it
+    // to the OS scheduler
+    int worker_cores[ZERO_JOBS_MAX_WORKERS];
+    // treat the end of every outermost jobs_run as a frame boundary
+    // for the worker's arena, otherwise call jobs_frame_boundary
+    // yourself. Passes run while waiting outside of a job, for example
+    // in job_group_wait, don't count.
+    int arena_frame_per_run;
+    // carve the small and large pools' fiber headers and stacks out of
+    // one slab per chunk backed by huge pages, explicit ones if any are
+    // reserved and transparent ones otherwise, to cut the TLB misses of
+    // switching between scattered stacks. Falls back to a malloc per
+    // fiber when neither is available, jobs_stack_backing tells which
+    // a pool got. Read by job_pool_init and as pools grow.
+    int huge_page_stacks;
+    // seconds between the job_pool_trim calls worker 0 makes from
+    // jobs_run, 0 to only trim when you call it yourself
+    double stack_trim_period;
+    // most jobs each job_pool_kind_t may hold. A pool that runs out
+    // grows towards its limit in chunks of its ZERO_JOBS_*_COUNT, and
+    // once there the job_alloc and job_create families wait for a slot
+    // to free up instead of returning NULL. 0 keeps the fixed pool of
+    // ZERO_JOBS_*_COUNT jobs that returns NULL when exhausted.
+    int pool_limits[JOB_POOL_SHARED + 1];
+    // seconds that wait for a slot may take before the allocation
+    // gives up and returns NULL, 0 to wait as long as it takes and
+    // negative to return NULL right away
+    double pool_wait_timeout;
+};
 
-    // TODO(Wynter): The below TODO is no longer true as I've
-    // implemented another workaround utilizing a queue of
-    // jobs that have yielded during that run. This does limit
-    // each job to running only once per run. This may not be
-    // an ideal solution in the long run however for the time
-    // being we can just continue to call run as many times as
-    // we want per frame to counter this issue.
-    //
-    // TODO(Wynter): If we don't check for time elapsed at
-    // the end of this loop, jobs could queue themselves
-    // into an endless loop. We could take in a callback
-    // that returns true/false for if the job queueing
-    // system should exit and run that check at the end
-    // of a job burst
-    while(run_queueing) {
-        int total_jobs = 0;
+struct job_arena_block_t {
+    struct job_arena_block_t *next;
+    size_t size;
+    size_t used;
+};
 
-        int num_jobs = jobs.size();
-        int num_waiting_jobs = waiting_jobs.size();
-        total_jobs += num_jobs + num_waiting_jobs;
+// Bump allocator for per-frame scratch memory. Each worker has
+// ZERO_JOBS_ARENA_FRAMES of these and rotates through them at every
+// frame boundary, rewinding the one it rotates onto. Blocks are kept
+// across frames so a steady workload stops allocating after warmup.
+struct job_arena_t {
+    struct job_arena_block_t *first;
+    struct job_arena_block_t *current;
+};
 
-//        printf("Running %i/%i jobs after %f\n", num_jobs, num_waiting_jobs, time);
+// One frame of a job_pipeline_t. Every stage is a group of its own, so
+// a stage of this frame can wait on a stage of the frame before it
+// without waiting for that whole frame. [arenas] hold memory allocated
+// with job_frame_alloc, one per worker, until the frame is retired.
+// [waiters] counts jobs parked in job_frame_wait_stage on this frame,
+// its slot in the ring isn't reused until they have all resumed.
+struct job_frame_t {
+    uint64_t index;
+    struct job_pipeline_t *pipeline;
+    job_group_t stages[ZERO_JOBS_PIPELINE_STAGES];
+    ZERO_ATOMIC(int) waiters;
+    job_arena_t arenas[ZERO_JOBS_MAX_WORKERS];
+};
 
-        while( jobs.size() ) {
-            running_jobs.push( jobs.front() );
-            jobs.pop();
-        }
+// A ring of up to [max_in_flight] frames. Frame N+1 can be begun and
+// its jobs run while frame N's jobs are still finishing; beginning a
+// frame only blocks when the ring is full, until the oldest frame is
+// done. Begin frames from one thread, outside of any job.
+struct job_pipeline_t {
+    int max_in_flight;
+    uint64_t next_index;
+    uint64_t oldest_index;
+    job_frame_t frames[ZERO_JOBS_PIPELINE_FRAMES];
+};
 
-        int waiting_size = waiting_jobs.size();
-        for(int i = 0; i < waiting_size; i++) {
-            auto wait_job = std::move(waiting_jobs.front());
-            waiting_jobs.pop();
+// run a graph node as an inline job, see job_create_inline
+#define JOB_GRAPH_INLINE (1 << 0)
 
-            bool still_waiting = false;
+struct job_graph_node_t {
+    zero_entrypoint_t entrypoint;
+    zero_userdata_t data;
+    int flags;
+    job_affinity_t affinity;
+    struct job_graph_t *graph;
+    int predecessor_count;
+    // range of this node's successors in job_graph_t::successors
+    int successor_first;
+    int successor_count;
+    // predecessors still to finish in the current run
+    ZERO_ATOMIC(int) remaining;
+};
 
-            switch(wait_job.condition) {
-                case job_waiting_t::JOB_WAIT_TIMER:
-                    if(time >= wait_job.end_time - ZERO_JOBS_TIMING_ERROR) {
-//                        printf("running job at %f awaiting %f\n", time, wait_job.end_time);
-                        running_jobs.push(wait_job.job);
-                    }
-                    else {
-//                        printf("waiting job at %f until %f\n", time, wait_job.end_time);
-                        still_waiting = true;
-                    }
-                break;
-                case job_waiting_t::JOB_WAIT_COUNTER_ZERO:
-                    if(wait_job.data_address && ZERO_ATOMIC_LOAD((ZERO_ATOMIC(int)*)wait_job.data_address) == 0) {
-                        running_jobs.push(wait_job.job);
-                    }
-                    else still_waiting = true;
-                break;
-                case job_waiting_t::JOB_WAIT_DATA_ZERO:
-                    // TODO(Wynter): Implement wait on zero at address
-                break;
-            }
-            if(still_waiting) {
-                waiting_jobs.push(wait_job);
-            }
-        }
+// A static dependency graph, built once and submitted any number of
+// times. Nodes only become jobs, and only take a fiber from the pool,
+// once their last predecessor has finished, so nothing is parked or
+// polled while waiting on its dependencies.
+struct job_graph_t {
+    std::vector<job_graph_node_t> nodes;
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> successors;
+    std::vector<int> roots;
+    job_group_t group;
+    bool built;
+};
 
-        if(!running_jobs.size()) {
-            run_queueing = false;
-        }
-        else {
-//            printf("jobs: t[%i], r[%ld], w[%ld]\n",
-//                    total_jobs,
-//                    running_jobs.size(),
-//                    waiting_jobs.size());
-            while( running_jobs.size() ) {
-                job_t job = running_jobs.front();
-                running_jobs.pop();
+// FIFO of job pointers in a power of two ring. A push that finds it
+// full doubles it, the scheduler's rings are reserved at
+// ZERO_JOBS_QUEUE_SIZE when a worker enters so that is rare.
+struct job_ring_t {
+    job_t **slots = nullptr;
+    uint32_t capacity = 0;
+    uint32_t head = 0;
+    uint32_t tail = 0;
 
-                job_current = &job;
-                zero_fiber_resume(job.fiber, NULL);
-                
-                if(!zero_fiber_is_active(job.fiber) && job.status_counter) {
-                    ZERO_ATOMIC_DECREMENT(job.status_counter);
-                }
-            }
-        }
-    }
-    while( yielded_jobs.size() ) {
-        jobs.push(yielded_jobs.front());
-        yielded_jobs.pop();
+    job_ring_t() = default;
+    job_ring_t(const job_ring_t&) = delete;
+    job_ring_t &operator=(const job_ring_t&) = delete;
+    ~job_ring_t();
+
+    size_t size() const { return tail - head; }
+    bool empty() const { return head == tail; }
+    job_t *front() const { return slots[head & (capacity - 1)]; }
+    job_t *at(size_t index) const { return slots[(head + index) & (capacity - 1)]; }
+    void pop() { head++; }
+
+    void push(job_t *job) {
+        if(tail - head == capacity) reserve(capacity ? capacity * 2 : 16);
+        slots[tail++ & (capacity - 1)] = job;
     }
-}
 
-ZERO_ATOMIC(int) *job_counter_make() {
-    return new ZERO_ATOMIC(int)(0);
-}
+    void reserve(uint32_t count);
+    // exchanges the contents of two rings without touching the jobs
+    void swap(job_ring_t &other);
+};
 
-//
-int job_pool_init() {
-    job_t *zero_jobs_small_pool = (job_t*) ZERO_JOBS_MALLOC(ZERO_JOBS_SMALL_COUNT * sizeof(job_t));
-    job_t *zero_jobs_large_pool = (job_t*) ZERO_JOBS_MALLOC(ZERO_JOBS_LARGE_COUNT * sizeof(job_t));
+// jobs handed to a worker from another thread, drained by that
+// worker at the start of every jobs_run pass
+struct job_inbox_t {
+    ZERO_ATOMIC(int) lock;
+    ZERO_ATOMIC(int) active;
+    job_ring_t jobs;
+};
 
-    zero_jobs_small_free_table = (ZERO_ATOMIC(job_t*)*) ZERO_JOBS_MALLOC(ZERO_JOBS_SMALL_COUNT * sizeof(job_t*));
-    zero_jobs_large_free_table = (ZERO_ATOMIC(job_t*)*) ZERO_JOBS_MALLOC(ZERO_JOBS_LARGE_COUNT * sizeof(job_t*));
+// hardware counters jobs_perf_enable can open
+#define JOB_PERF_CYCLES        (1u << 0)
+#define JOB_PERF_INSTRUCTIONS  (1u << 1)
+#define JOB_PERF_CACHE_MISSES  (1u << 2)
+#define JOB_PERF_BRANCH_MISSES (1u << 3)
 
-    for(size_t slot = 0; slot < ZERO_JOBS_SMALL_COUNT; slot++) {
-        zero_jobs_small_free_table[slot] = &zero_jobs_small_pool[slot];
-        job_t * j = (job_t*)ZERO_ATOMIC_LOAD( zero_jobs_small_free_table + slot );
-        j->fiber = zero_fiber_make("", ZERO_JOBS_SMALL_SIZE, NULL, NULL);
-    }
+// Counter totals for every job run with [entrypoint], or for every job
+// given [description] when the jobs were described. [runs] counts
+// resumes, not jobs. Counters that couldn't be opened stay 0.
+struct job_perf_stats_t {
+    zero_entrypoint_t entrypoint;
+    const char *description;
+    uint64_t runs;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+    uint64_t branch_misses;
+};
 
-    for(size_t slot = 0; slot < ZERO_JOBS_LARGE_COUNT; slot++) {
-        zero_jobs_large_free_table[slot] = &zero_jobs_large_pool[slot];
-        job_t * j = (job_t*)ZERO_ATOMIC_LOAD( zero_jobs_large_free_table + slot );
-        j->fiber = zero_fiber_make("", ZERO_JOBS_LARGE_SIZE, NULL, NULL);
-    }
-    
-    return 0;
-}
+// run each tick of a periodic job inline, see job_create_inline
+#define JOB_PERIODIC_INLINE (1 << 0)
 
-//
-job_t* job_alloc(zero_entrypoint_t entrypoint, zero_userdata_t data) {
-    job_t* job = NULL;
+// A recurring job, owned by the timer heap of the thread that created
+// it. Every tick queues a fresh job, so nothing is kept alive between
+// ticks. Ticks stay on the [period] grid from the first one however
+// late jobs_run is called. Ticks that were missed, or that come
+// while the previous tick's job is still running, are dropped and
+// counted in [missed] rather than run late.
+struct job_periodic_t {
+    zero_entrypoint_t entrypoint;
+    zero_userdata_t data;
+    double period;
+    double next_time;
+    int flags;
+    job_affinity_t affinity;
+    ZERO_ATOMIC(int) in_flight;
+    ZERO_ATOMIC(int) cancelled;
+    uint64_t ticks;
+    uint64_t missed;
+};
 
-    for(size_t slot = 0; slot < ZERO_JOBS_SMALL_COUNT; slot++) {
-        if( (job = (job_t*) ZERO_ATOMIC_LOAD(&zero_jobs_small_free_table[slot])) != NULL) {
-            if(ZERO_ATOMIC_CAS(zero_jobs_small_free_table + slot, job, (job_t*) NULL)) {
-                zero_context_derive(job->fiber->context, job->fiber->stack_size, entrypoint);
-                job->fiber->entrypoint = entrypoint;
-                job->fiber->userdata = data;
-                job->fiber->status = ZERO_FIBER_STARTED;
-                // memset(job->fiber->context, 0, job->fiber->stack_size);
-                return job;
-            }
-        }
-    }
+// A job that has been running on [worker] without yielding for longer
+// than the watchdog threshold. [stack] holds the return addresses of
+// its frames, innermost first, when stack capture was asked for and is
+// supported (x86_64 Linux, built with frame pointers).
+struct job_stall_t {
+    int worker;
+    zero_entrypoint_t entrypoint;
+    const char *description;
+    uint32_t resumes;
+    uint64_t running_ns;
+    int depth;
+    void *stack[ZERO_JOBS_WATCHDOG_DEPTH];
+};
 
-    return NULL;
-}
+typedef void (*job_stall_callback_t)(const job_stall_t *stall, void *userdata);
 
-//
-job_t* job_alloc_large(zero_entrypoint_t entrypoint, zero_userdata_t data) {
-    job_t* job = NULL;
+// Scheduler timing for the calling thread, a pass is one jobs_run call.
+struct jobs_stats_t {
+    uint64_t passes;
+    uint64_t last_pass_ns;
+    uint64_t max_pass_ns;
+    uint64_t total_pass_ns;
+    uint64_t resumes;
+};
 
-    for(size_t slot = 0; slot < ZERO_JOBS_SMALL_COUNT; slot++) {
-        if( (job = (job_t*) ZERO_ATOMIC_LOAD(&zero_jobs_large_free_table[slot])) != NULL) {
-            if(ZERO_ATOMIC_CAS(&zero_jobs_large_free_table[slot], job, (job_t*) NULL)) {
-                job->fiber->entrypoint = entrypoint;
-                job->fiber->userdata = data;
-                // memset(job->fiber->context, 0, job->fiber->stack_size);
-                return job;
-            }
-        }
-    }
+// Occupancy of one job pool, counted in slots.
+struct job_pool_stats_t {
+    // slots the pool has grown to so far, and may grow to
+    int capacity;
+    int limit;
+    int in_use;
+    // most slots ever in use at once
+    int high_water;
+    // slots whose fiber stack is still backed by memory
+    int resident;
+};
 
-    return NULL;
-}
+extern thread_local job_ring_t jobs;
+extern thread_local job_ring_t yielded_jobs;
+// jobs parked in a wait, see job_t::wait
+extern thread_local job_ring_t waiting_jobs;
+extern thread_local struct job_t *job_current;
+extern thread_local double latest_time;
+extern thread_local int job_worker_index;
 
-//
-void job_free(job_t* job) {
-    size_t size = job->fiber->stack_size;
-    job->fiber->entrypoint = NULL;
+int jobs_configure(const jobs_config_t *config);
+int jobs_worker_enter(int worker);
+void jobs_worker_exit();
+int jobs_worker_count();
+void jobs_run(double time);
+void jobs_frame_boundary();
+uint64_t jobs_clock_ns();
+double jobs_clock();
+double jobs_next_deadline();
+void jobs_run_until_idle(ZERO_ATOMIC(int) *stop = NULL);
+void jobs_wake(int worker);
+void jobs_stats(jobs_stats_t *stats);
+void jobs_stats_reset();
 
-    ZERO_ATOMIC(job_t*)* table = NULL;
-    
-    if(size == ZERO_JOBS_SMALL_SIZE) {
-        table = zero_jobs_small_free_table;
-    }
-    else if(size == ZERO_JOBS_LARGE_SIZE) {
-        table = zero_jobs_large_free_table;
-    }
-    else {
-        // TODO(Wynter): It should never get here
-        //   If it does, the API user is likely doing something very wrong
-        //   please error out here
-    }
+int jobs_watchdog_start(uint64_t threshold_ns, job_stall_callback_t callback = NULL, void *userdata = NULL, int capture_stack = 0);
+void jobs_watchdog_stop();
 
-    // loop through job pool searching for first nullptr slot
-    // we can use CAS here because if a slot isn't nullptr, nothing is written
-    for(size_t slot = 0; slot < ZERO_JOBS_SMALL_COUNT; slot++) {
-        if( (job = (job_t*) ZERO_ATOMIC_LOAD(&table[slot])) == NULL) {
-            if(ZERO_ATOMIC_CAS(&table[slot], NULL, (job_t*) job)) {
-                return;
-            }
-        }
-    }
+void *job_arena_alloc(size_t size, size_t align = 16);
+
+int jobs_perf_enable();
+void jobs_perf_disable();
+int jobs_perf_stats(job_perf_stats_t *stats, int max_stats);
+void jobs_perf_reset();
+void jobs_perf_print(FILE *out);
+
+int job_pool_init();
+enum job_stack_backing_t jobs_stack_backing(enum job_pool_kind_t pool);
+size_t job_pool_trim();
+void job_pool_stats(enum job_pool_kind_t pool, job_pool_stats_t *stats);
+job_t* job_alloc(zero_entrypoint_t entrypoint, zero_userdata_t data);
+job_t* job_alloc_large(zero_entrypoint_t entrypoint, zero_userdata_t data);
+job_t* job_alloc_inline(zero_entrypoint_t entrypoint, zero_userdata_t data);
+job_t* job_alloc_shared(zero_entrypoint_t entrypoint, zero_userdata_t data);
+job_t* job_alloc_heap(zero_entrypoint_t entrypoint, zero_userdata_t data);
+void job_free(job_t* job);
+
+ZERO_ATOMIC(int) *job_counter_make();
+void job_counter_free(ZERO_ATOMIC(int) *counter);
+
+job_t* job_create(zero_entrypoint_t job_entrypoint, ZERO_ATOMIC(int) *counter, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_create_inline(zero_entrypoint_t job_entrypoint, zero_userdata_t data, ZERO_ATOMIC(int) *counter, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_create_shared(zero_entrypoint_t job_entrypoint, zero_userdata_t data, ZERO_ATOMIC(int) *counter, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_create_capture(enum job_pool_kind_t pool, zero_entrypoint_t thunk, void (*move)(void*, void*), void (*destroy)(void*),
+                          void *closure, size_t size, size_t align, ZERO_ATOMIC(int) *counter, job_affinity_t affinity,
+                          job_handle_t *handle = NULL);
+job_handle_t job_create_handle(zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+int job_await(job_handle_t handle, zero_userdata_t *result);
+void job_release(job_handle_t handle);
+void job_cancel(job_t *job);
+void job_cancel(job_handle_t handle);
+int job_is_cancelled();
+void job_describe(job_t *job, const char *description);
+
+int job_yield();
+int job_wait(double time);
+int job_wait_on_condition(ZERO_ATOMIC(int) *counter);
+int job_wait_on_condition_timeout(ZERO_ATOMIC(int) *counter, double timeout);
+int job_wait_zero(void *address);
+int job_wait_zero_timeout(void *address, double timeout);
+int job_wait_fd(int fd, int events, double timeout = JOB_WAIT_FOREVER);
+int job_fd_nonblocking(int fd);
+intptr_t job_read(int fd, void *buffer, size_t size);
+intptr_t job_write(int fd, const void *buffer, size_t size);
+zero_userdata_t job_run_blocking(zero_entrypoint_t entrypoint, zero_userdata_t data);
+void jobs_blocking_stop();
+
+job_periodic_t* job_periodic_create(zero_entrypoint_t job_entrypoint, zero_userdata_t data, double period, int flags = 0, job_affinity_t affinity = JOB_AFFINITY_ANY);
+void job_periodic_cancel(job_periodic_t *periodic);
+
+int job_pipeline_init(job_pipeline_t *pipeline, int max_in_flight);
+void job_pipeline_flush(job_pipeline_t *pipeline);
+void job_pipeline_destroy(job_pipeline_t *pipeline);
+job_frame_t* job_frame_begin(job_pipeline_t *pipeline);
+job_frame_t* job_frame_previous(job_frame_t *frame);
+job_t* job_frame_create(job_frame_t *frame, int stage, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_frame_create_inline(job_frame_t *frame, int stage, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+int job_frame_wait_stage(job_frame_t *frame, int stage);
+int job_frame_done(job_frame_t *frame);
+void *job_frame_alloc(job_frame_t *frame, size_t size, size_t align = 16);
+
+void job_graph_init(job_graph_t *graph);
+int job_graph_add(job_graph_t *graph, zero_entrypoint_t job_entrypoint, zero_userdata_t data, int flags = 0, job_affinity_t affinity = JOB_AFFINITY_ANY);
+int job_graph_depend(job_graph_t *graph, int node, int predecessor);
+int job_graph_build(job_graph_t *graph);
+int job_graph_submit(job_graph_t *graph);
+int job_graph_wait(job_graph_t *graph);
+void job_graph_cancel(job_graph_t *graph);
+
+void job_group_init(job_group_t *group);
+job_t* job_group_create(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_group_create_inline(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+job_t* job_group_create_shared(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity = JOB_AFFINITY_ANY);
+void job_group_cancel(job_group_t *group);
+int job_group_wait(job_group_t *group);
+
+template<typename C>
+void *job_closure_thunk(void *data) {
+    (*(C*)data)();
+    return nullptr;
+}
+
+template<typename C>
+void job_closure_move(void *storage, void *closure) {
+    new(storage) C(std::move(*(C*)closure));
+}
+
+template<typename C>
+void job_closure_destroy(void *closure) {
+    ((C*)closure)->~C();
+}
+
+// Any callable that isn't a plain zero_entrypoint_t, typically a
+// capturing lambda. The closure is moved into the job record, or into
+// a block of its own from ZERO_JOBS_MALLOC if it is larger than
+// ZERO_JOBS_CAPTURE_SIZE or needs more than 16 byte alignment, and is
+// destroyed when the job is freed. Returns NULL, like the job pool
+// being exhausted, if that block can't be allocated.
+template<typename F, typename C = typename std::decay<F>::type,
+         typename = typename std::enable_if<!std::is_convertible<C, zero_entrypoint_t>::value>::type>
+job_t* job_create(F &&f, ZERO_ATOMIC(int) *counter = NULL, job_affinity_t affinity = JOB_AFFINITY_ANY) {
+    C closure(std::forward<F>(f));
+    return job_create_capture(JOB_POOL_SMALL, job_closure_thunk<C>, job_closure_move<C>, job_closure_destroy<C>,
+                              &closure, sizeof(C), alignof(C), counter, affinity);
+}
+
+template<typename F, typename C = typename std::decay<F>::type,
+         typename = typename std::enable_if<!std::is_convertible<C, zero_entrypoint_t>::value>::type>
+job_t* job_create_inline(F &&f, ZERO_ATOMIC(int) *counter = NULL, job_affinity_t affinity = JOB_AFFINITY_ANY) {
+    C closure(std::forward<F>(f));
+    return job_create_capture(JOB_POOL_INLINE, job_closure_thunk<C>, job_closure_move<C>, job_closure_destroy<C>,
+                              &closure, sizeof(C), alignof(C), counter, affinity);
+}
+
+template<typename C, typename R>
+void *job_future_thunk(void *data) {
+    zero_userdata_t result = nullptr;
+    if constexpr (std::is_void<R>::value) {
+        (*(C*)data)();
+    }
+    else {
+        R value = (*(C*)data)();
+        memcpy(&result, &value, sizeof(R));
+    }
+    return result;
+}
+
+template<typename R>
+struct job_result_fits : std::integral_constant<bool, std::is_trivially_copyable<R>::value && sizeof(R) <= sizeof(zero_userdata_t)> {};
+
+template<>
+struct job_result_fits<void> : std::true_type {};
+
+// Runs a closure as a fiber job whose return value job_await hands
+// back. The value travels in the job record's result slot, so it must
+// be trivially copyable and no larger than a pointer. The future must
+// be passed to job_await or job_release exactly once, a future whose
+// job couldn't be created has a NULL handle.job.
+template<typename F, typename C = typename std::decay<F>::type, typename R = decltype(std::declval<C&>()())>
+job_future_t<R> job_create_future(F &&f, job_affinity_t affinity = JOB_AFFINITY_ANY) {
+    static_assert(job_result_fits<R>::value, "job_create_future results must fit in a pointer");
+
+    C closure(std::forward<F>(f));
+    job_future_t<R> future = { { NULL, 0 } };
+    job_create_capture(JOB_POOL_SMALL, job_future_thunk<C, R>, job_closure_move<C>, job_closure_destroy<C>,
+                       &closure, sizeof(C), alignof(C), NULL, affinity, &future.handle);
+    return future;
+}
+
+template<typename T>
+int job_await(job_future_t<T> future, T *result) {
+    zero_userdata_t value = nullptr;
+    int status = job_await(future.handle, &value);
+    if(status != -1 && result) {
+        memcpy(result, &value, sizeof(T));
+    }
+    return status;
+}
+
+// Runs a callable on the blocking thread pool, see the entrypoint form
+// of job_run_blocking, and returns what it returned. The callable and
+// its result stay on the calling job's stack, so they can be any size.
+template<typename F, typename C = typename std::decay<F>::type, typename R = decltype(std::declval<C&>()()),
+         typename = typename std::enable_if<!std::is_convertible<C, zero_entrypoint_t>::value>::type>
+R job_run_blocking(F &&f) {
+    typedef typename std::remove_reference<F>::type callable_t;
+
+    if constexpr (std::is_void<R>::value) {
+        job_run_blocking([](void *callable) -> void* {
+            (*(callable_t*)callable)();
+            return nullptr;
+        }, (void*)&f);
+    }
+    else {
+        struct call_t {
+            callable_t *callable;
+            std::optional<R> result;
+        } call = { &f, std::nullopt };
+
+        job_run_blocking([](void *data) -> void* {
+            call_t *call = (call_t*)data;
+            call->result.emplace((*call->callable)());
+            return nullptr;
+        }, (void*)&call);
+        return std::move(*call.result);
+    }
+}
+
+inline int job_await(job_future_t<void> future) {
+    return job_await(future.handle, NULL);
+}
+
+template<typename T>
+void job_release(job_future_t<T> future) {
+    job_release(future.handle);
+}
+
+template<typename T>
+void job_cancel(job_future_t<T> future) {
+    job_cancel(future.handle);
+}
+
+#endif // ZERO_JOBS_INCLUDED
+
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#if defined(ZERO_JOBS_IMPL) && !defined(ZERO_JOBS_IMPL_INCLUDED)
+#define ZERO_JOBS_IMPL_INCLUDED (1)
+
+#include <math.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#if ZERO_ATOMIC_LINUX
+#include <signal.h>
+#include <ucontext.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#endif
+
+thread_local job_ring_t jobs;
+thread_local job_ring_t yielded_jobs;
+thread_local job_ring_t waiting_jobs;
+// what jobs_run runs this round, swapped with [jobs]
+thread_local job_ring_t job_running;
+thread_local struct job_t *job_current = nullptr;
+thread_local double latest_time = 0.0;
+thread_local int job_worker_index = -1;
+// jobs_run calls and job_pump waits under way on this thread, only the
+// outermost jobs_run ends an arena frame
+thread_local int job_run_depth = 0;
+
+static void job_arena_release(job_arena_t *arena);
+
+// a thread's arena for each frame in flight, released when it exits
+struct job_thread_arenas_t {
+    job_arena_t frames[ZERO_JOBS_ARENA_FRAMES];
+
+    ~job_thread_arenas_t() {
+        for(int frame = 0; frame < ZERO_JOBS_ARENA_FRAMES; frame++) {
+            job_arena_release(&frames[frame]);
+        }
+    }
+};
+
+thread_local job_thread_arenas_t job_arenas;
+thread_local unsigned int job_arena_frame = 0;
+
+// this thread's perf event group, the leader is -1 while not counting
+thread_local int job_perf_fds[4] = { -1, -1, -1, -1 };
+thread_local unsigned int job_perf_order[4];
+thread_local int job_perf_count = 0;
+thread_local jobs_stats_t job_stats = { 0 };
+// min-heap on next_time of the periodic jobs this thread owns
+thread_local std::vector<job_periodic_t*> job_periodic_heap;
+// cancelled periodic jobs whose last tick's job is still running
+thread_local std::vector<job_periodic_t*> job_periodic_retired;
+// job_periodic_cancel calls this thread has swept its heap for
+thread_local int job_periodic_cancels_seen = 0;
+
+jobs_config_t zero_jobs_config = { 0 };
+// bumped by job_periodic_cancel, see job_periodic_sweep
+ZERO_ATOMIC(int) zero_jobs_periodic_cancels = 0;
+job_inbox_t zero_jobs_inboxes[ZERO_JOBS_MAX_WORKERS];
+
+// What each worker is running, written by the worker around every
+// resume while the watchdog is on and read by the watchdog thread.
+// [start_ns] is 0 while the worker is between jobs.
+struct job_worker_slot_t {
+    ZERO_ATOMIC(uint64_t) start_ns;
+    zero_entrypoint_t entrypoint;
+    const char *description;
+    uint32_t resumes;
+    ZERO_ATOMIC(int) stack_ready;
+    int depth;
+    void *stack[ZERO_JOBS_WATCHDOG_DEPTH];
+};
+
+// Where jobs_run_until_idle sleeps. [sleeping] lets job_push skip the
+// mutex when nobody is asleep, [woken] keeps a wake that arrives just
+// before the sleep from being lost.
+struct job_waker_t {
+    std::mutex lock;
+    std::condition_variable signal;
+    bool woken;
+    ZERO_ATOMIC(int) sleeping;
+    // eventfd in the worker's epoll set while it has a reactor, so a
+    // wake also ends a sleep in epoll_wait
+    int io_event = -1;
+};
+
+job_waker_t zero_jobs_wakers[ZERO_JOBS_MAX_WORKERS];
+// for threads that never entered as a worker
+thread_local job_waker_t job_waker;
+
+// A job_run_blocking call, lives on the stack of the parked job
+struct job_blocking_call_t {
+    zero_entrypoint_t entrypoint;
+    zero_userdata_t data;
+    zero_userdata_t result;
+    ZERO_ATOMIC(int) pending;
+    int worker;
+};
+
+void jobs_blocking_stop();
+
+// Threads are only started when a call finds no idle one, and stay
+// until jobs_blocking_stop, which also runs at exit.
+struct job_blocking_pool_t {
+    std::mutex lock;
+    std::condition_variable signal;
+    std::queue<job_blocking_call_t*> calls;
+    std::vector<std::thread> threads;
+    int idle = 0;
+    bool stopping = false;
+
+    ~job_blocking_pool_t() { jobs_blocking_stop(); }
+};
+
+job_blocking_pool_t zero_jobs_blocking;
+
+// The jobs parked in job_wait_fd on one fd, at most one per direction.
+// epoll keeps a single registration per fd, so it watches for what
+// either job waits on and a report can wake both.
+struct job_io_fd_t {
+    int fd;
+    job_t *reader;
+    job_t *writer;
+};
+
+// the calling thread's reactor for job_wait_fd, created on first use
+thread_local int job_io_epoll = -1;
+thread_local int job_io_waiters = 0;
+// keyed by fd, the records' addresses are what epoll hands back
+thread_local std::unordered_map<int, job_io_fd_t> job_io_fds;
+
+job_worker_slot_t zero_jobs_worker_slots[ZERO_JOBS_MAX_WORKERS];
+ZERO_ATOMIC(int) zero_jobs_watchdog_active = 0;
+std::thread zero_jobs_watchdog_thread;
+#if ZERO_ATOMIC_LINUX
+pthread_t zero_jobs_worker_threads[ZERO_JOBS_MAX_WORKERS];
+#endif
+
+ZERO_ATOMIC(int) zero_jobs_perf_lock;
+job_perf_stats_t zero_jobs_perf_table[ZERO_JOBS_PERF_ENTRIES];
+
+// One of the job pools, indexed by job_pool_kind_t. Job records are
+// added [chunk] at a time and never moved or freed, so job pointers
+// stay valid as the pool grows. The free table has room for
+// ZERO_JOBS_POOL_MAX_CHUNKS chunks from the start and only its first
+// [capacity] slots are used, so growing never moves it either.
+struct job_pool_t {
+    ZERO_ATOMIC(job_t*) *table;
+    ZERO_ATOMIC(int) capacity;
+    int chunk;
+    // 0 for pools whose jobs have no stack of their own
+    size_t stack_size;
+    // held while a chunk is added
+    ZERO_ATOMIC(int) growing;
+    // slots in use, the most ever in use, the most in use since the
+    // last job_pool_trim and the stacks that trim released
+    ZERO_ATOMIC(int) used;
+    ZERO_ATOMIC(int) high_water;
+    ZERO_ATOMIC(int) window_high;
+    ZERO_ATOMIC(int) trimmed;
+    // threads outside of any job waiting for a slot, job_free wakes
+    // the workers while there are any
+    ZERO_ATOMIC(int) waiting;
+    // what its chunks' stacks were allocated from
+    enum job_stack_backing_t backing;
+};
+
+job_pool_t zero_jobs_pools[JOB_POOL_SHARED + 1];
+// when worker 0 last trimmed, see jobs_config_t::stack_trim_period
+uint64_t zero_jobs_trim_ns = 0;
+
+static void job_spin_lock(ZERO_ATOMIC(int) *lock) {
+    while(ZERO_ATOMIC_CAS(lock, 0, 1) != 0) {
+        // spin, the critical sections are a single queue operation
+        // or table update
+    }
+}
+
+static void job_spin_unlock(ZERO_ATOMIC(int) *lock) {
+    ZERO_ATOMIC_SWAP(lock, 0);
+}
+
+job_ring_t::~job_ring_t() {
+    ZERO_JOBS_FREE(slots);
+}
+
+// grows to at least [count] slots, never shrinks
+void job_ring_t::reserve(uint32_t count) {
+    uint32_t grown = capacity ? capacity : 16;
+    while(grown < count) grown *= 2;
+    if(grown == capacity) return;
+
+    job_t **grown_slots = (job_t**) ZERO_JOBS_MALLOC(grown * sizeof(job_t*));
+    ZERO_JOBS_ASSERT(grown_slots);
+
+    uint32_t count_used = tail - head;
+    for(uint32_t i = 0; i < count_used; i++) {
+        grown_slots[i] = slots[(head + i) & (capacity - 1)];
+    }
+
+    ZERO_JOBS_FREE(slots);
+    slots = grown_slots;
+    capacity = grown;
+    head = 0;
+    tail = count_used;
+}
+
+void job_ring_t::swap(job_ring_t &other) {
+    std::swap(slots, other.slots);
+    std::swap(capacity, other.capacity);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+}
+
+static void job_inbox_lock(job_inbox_t *inbox) {
+    job_spin_lock(&inbox->lock);
+}
+
+static void job_inbox_unlock(job_inbox_t *inbox) {
+    job_spin_unlock(&inbox->lock);
+}
+
+// walks up through the groups a job belongs to and the jobs owning them
+static int job_cancel_requested(job_t *job) {
+    while(job) {
+        if(ZERO_ATOMIC_LOAD(&job->cancelled)) return 1;
+
+        job_group_t *group = job->group;
+        if(!group) return 0;
+        if(ZERO_ATOMIC_LOAD(&group->cancelled)) return 1;
+
+        job = group->owner;
+    }
+    return 0;
+}
+
+static void job_periodic_fire(double time);
+static void job_periodic_sweep();
+static job_waker_t *job_waker_current();
+static void job_io_close();
+
+// reads this thread's counters in the order they were opened, -1 if
+// it isn't counting
+static int job_perf_read(uint64_t values[4]) {
+#if ZERO_ATOMIC_LINUX
+    if(job_perf_fds[0] < 0) return -1;
+
+    uint64_t group[1 + 4];
+    if(read(job_perf_fds[0], group, sizeof(group)) < (ssize_t)sizeof(uint64_t)) return -1;
+
+    for(int i = 0; i < job_perf_count && i < (int)group[0]; i++) {
+        values[i] = group[1 + i];
+    }
+    return 0;
+#else
+    (void)values;
+    return -1;
+#endif
+}
+
+// adds the counters since [start] to the stats entry for [job]
+static void job_perf_record(job_t *job, const uint64_t start[4]) {
+    uint64_t end[4];
+    if(job_perf_read(end) != 0) return;
+
+    const void *key = job->description ? (const void*)job->description : (const void*)job->entrypoint;
+    size_t index = ((uintptr_t)key >> 4) % ZERO_JOBS_PERF_ENTRIES;
+
+    job_spin_lock(&zero_jobs_perf_lock);
+    for(size_t probe = 0; probe < ZERO_JOBS_PERF_ENTRIES; probe++) {
+        job_perf_stats_t *entry = &zero_jobs_perf_table[(index + probe) % ZERO_JOBS_PERF_ENTRIES];
+
+        if(entry->runs == 0) {
+            entry->entrypoint = job->entrypoint;
+            entry->description = job->description;
+        }
+        else if(entry->description != job->description ||
+                (!job->description && entry->entrypoint != job->entrypoint)) {
+            continue;
+        }
+
+        entry->runs++;
+        for(int i = 0; i < job_perf_count; i++) {
+            uint64_t delta = end[i] - start[i];
+            switch(job_perf_order[i]) {
+                case JOB_PERF_CYCLES:        entry->cycles += delta; break;
+                case JOB_PERF_INSTRUCTIONS:  entry->instructions += delta; break;
+                case JOB_PERF_CACHE_MISSES:  entry->cache_misses += delta; break;
+                case JOB_PERF_BRANCH_MISSES: entry->branch_misses += delta; break;
+            }
+        }
+        break;
+    }
+    // a full table drops the sample
+    job_spin_unlock(&zero_jobs_perf_lock);
+}
+
+// Routes a job to the worker its affinity mask asks for. Jobs that can
+// run here go straight onto this thread's queue, everything else goes
+// to the inbox of the lowest numbered worker the mask allows.
+static void job_push(job_t *job) {
+    job_affinity_t mask = job->affinity & ~JOB_AFFINITY_PREFER;
+
+    if(mask == JOB_AFFINITY_ANY || (job_worker_index >= 0 && (mask & JOB_AFFINITY_WORKER(job_worker_index)))) {
+        jobs.push(job);
+        return;
+    }
+
+    int target = -1;
+    for(int worker = 0; worker < ZERO_JOBS_MAX_WORKERS; worker++) {
+        if(!(mask & JOB_AFFINITY_WORKER(worker))) continue;
+
+        if(target < 0) target = worker;
+        if(ZERO_ATOMIC_LOAD(&zero_jobs_inboxes[worker].active)) {
+            target = worker;
+            break;
+        }
+    }
+
+    if(target < 0 || ((job->affinity & JOB_AFFINITY_PREFER) && !ZERO_ATOMIC_LOAD(&zero_jobs_inboxes[target].active))) {
+        jobs.push(job);
+        return;
+    }
+
+    job_inbox_t *inbox = &zero_jobs_inboxes[target];
+    job_inbox_lock(inbox);
+    inbox->jobs.push(job);
+    job_inbox_unlock(inbox);
+
+    if(ZERO_ATOMIC_LOAD(&zero_jobs_wakers[target].sleeping)) {
+        jobs_wake(target);
+    }
+}
+
+static int job_pin_thread(int core) {
+#if ZERO_ATOMIC_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#elif ZERO_ATOMIC_WINDOWS
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) ? 0 : -1;
+#else
+    // macOS only offers affinity hints, not pinning
+    (void)core;
+    return -1;
+#endif
+}
+
+// Sets up worker count and core pinning. Call before job_pool_init
+// and before any worker thread calls jobs_worker_enter.
+int jobs_configure(const jobs_config_t *config) {
+    if(!config || config->worker_count < 1 || config->worker_count > ZERO_JOBS_MAX_WORKERS) {
+        return -1;
+    }
+
+    zero_jobs_config = *config;
+    return 0;
+}
+
+// Binds the calling thread to worker slot [worker] and pins it to the
+// configured core. Jobs with an affinity for this worker are only run
+// by a thread that has entered as it. Returns -1 if the slot is out of
+// range or pinning failed; the thread is still registered in the
+// latter case.
+int jobs_worker_enter(int worker) {
+    int worker_limit = zero_jobs_config.worker_count ? zero_jobs_config.worker_count : ZERO_JOBS_MAX_WORKERS;
+    if(worker < 0 || worker >= worker_limit) {
+        return -1;
+    }
+
+    job_worker_index = worker;
+#if ZERO_ATOMIC_LINUX
+    zero_jobs_worker_threads[worker] = pthread_self();
+#endif
+    jobs.reserve(ZERO_JOBS_QUEUE_SIZE);
+    yielded_jobs.reserve(ZERO_JOBS_QUEUE_SIZE);
+    waiting_jobs.reserve(ZERO_JOBS_QUEUE_SIZE);
+    job_running.reserve(ZERO_JOBS_QUEUE_SIZE);
+    ZERO_ATOMIC_SWAP(&zero_jobs_inboxes[worker].active, 1);
+
+    if(zero_jobs_config.worker_count && zero_jobs_config.worker_cores[worker] >= 0) {
+        return job_pin_thread(zero_jobs_config.worker_cores[worker]);
+    }
+    return 0;
+}
+
+void jobs_worker_exit() {
+    if(job_worker_index < 0) return;
+
+    ZERO_ATOMIC_SWAP(&zero_jobs_inboxes[job_worker_index].active, 0);
+    job_io_close();
+    job_worker_index = -1;
+    jobs_perf_disable();
+}
+
+// the configured worker count, 1 if jobs_configure was never called
+int jobs_worker_count() {
+    return zero_jobs_config.worker_count ? zero_jobs_config.worker_count : 1;
+}
+
+// Creates the calling thread's epoll set along with the eventfd that
+// jobs_wake writes to.
+static int job_io_open() {
+#if ZERO_ATOMIC_LINUX
+    if(job_io_epoll >= 0) return 0;
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll < 0) return -1;
+
+    int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if(event_fd < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, event_fd, &event) != 0) {
+        if(event_fd >= 0) close(event_fd);
+        close(epoll);
+        return -1;
+    }
+
+    job_io_epoll = epoll;
+    job_waker_current()->io_event = event_fd;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// only once no job is parked on the reactor
+static void job_io_close() {
+#if ZERO_ATOMIC_LINUX
+    if(job_io_epoll < 0 || job_io_waiters) return;
+
+    job_waker_t *waker = job_waker_current();
+    int event_fd = waker->io_event;
+    waker->io_event = -1;
+    close(event_fd);
+    close(job_io_epoll);
+    job_io_epoll = -1;
+#endif
+}
+
+// Points [record]'s registration at what its jobs still wait on,
+// dropping it along with the record once neither is left. Returns -1
+// if epoll won't watch the fd.
+static int job_io_arm(job_io_fd_t *record) {
+#if ZERO_ATOMIC_LINUX
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    if(record->reader) event.events |= EPOLLIN | EPOLLRDHUP;
+    if(record->writer) event.events |= EPOLLOUT;
+    event.data.ptr = record;
+
+    int fd = record->fd;
+    if(!event.events) {
+        epoll_ctl(job_io_epoll, EPOLL_CTL_DEL, fd, &event);
+        job_io_fds.erase(fd);
+        return 0;
+    }
+    if(epoll_ctl(job_io_epoll, EPOLL_CTL_MOD, fd, &event) != 0 &&
+       (errno != ENOENT || epoll_ctl(job_io_epoll, EPOLL_CTL_ADD, fd, &event) != 0)) {
+        return -1;
+    }
+    return 0;
+#else
+    (void)record;
+    return -1;
+#endif
+}
+
+// takes [job] off [fd]'s record if epoll hasn't woken it already
+static void job_io_forget(int fd, job_t *job) {
+    auto found = job_io_fds.find(fd);
+    if(found == job_io_fds.end()) return;
+
+    job_io_fd_t *record = &found->second;
+    if(record->reader != job && record->writer != job) return;
+    if(record->reader == job) record->reader = NULL;
+    if(record->writer == job) record->writer = NULL;
+    job_io_arm(record);
+}
+
+// Marks the jobs whose fds are ready, waiting up to [timeout_ms] (-1
+// for no limit) when nothing is. Woken jobs are taken off their fd's
+// registration right away. Returns the number of events.
+static int job_io_poll(int timeout_ms) {
+#if ZERO_ATOMIC_LINUX
+    struct epoll_event events[64];
+    int count = epoll_wait(job_io_epoll, events, 64, timeout_ms);
+
+    for(int i = 0; i < count; i++) {
+        job_io_fd_t *record = (job_io_fd_t*)events[i].data.ptr;
+        if(!record) {
+            uint64_t value;
+            ssize_t drained = read(job_waker_current()->io_event, &value, sizeof(value));
+            (void)drained;
+            continue;
+        }
+
+        // errors and hangups wake both directions
+        uint32_t ready = events[i].events;
+        if(record->reader && (ready & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))) {
+            record->reader->io_pending = 0;
+            record->reader = NULL;
+        }
+        if(record->writer && (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            record->writer->io_pending = 0;
+            record->writer = NULL;
+        }
+        job_io_arm(record);
+    }
+    return count < 0 ? 0 : count;
+#else
+    (void)timeout_ms;
+    return 0;
+#endif
+}
+
+// job_t::handle_state, a held job that has finished is zero so
+// job_await can park on it like on a counter
+enum {
+    JOB_HANDLE_DONE = 0,
+    JOB_HANDLE_HELD,
+    JOB_HANDLE_NONE,
+    JOB_HANDLE_RELEASED
+};
+
+// a held job keeps its slot until job_await or job_release
+static void job_finish(job_t *job) {
+    if(job->status_counter) {
+        ZERO_ATOMIC_DECREMENT(job->status_counter);
+    }
+    if(ZERO_ATOMIC_CAS(&job->handle_state, JOB_HANDLE_HELD, JOB_HANDLE_DONE) != JOB_HANDLE_HELD) {
+        job_free(job);
+    }
+}
+
+// [jobs_run] should take a floating point number for the current
+// time it should pull the jobs in [jobs] as well as any available
+// to run in [waiting_jobs], remove them from their queues and place
+// them into a temporary queue. The jobs in this temporary queue are
+// then run as fibers, where they can be placed back into the main
+// [jobs] queue or the [waiting_jobs] queue if their execution is
+// dependent on a fulfilled condition.
+//
+// Bonus: jobs/waiting_jobs should be made into thread-safe queues
+// whereby any thread can pull from them and any thread can place
+// new jobs into them. Jobs should be exchangeable between threads.
+// 
+// This could potentially be done by using multiple spsc queues for
+// every thread and using those for communication between the job
+// scheduler and individual thread execution units. An idea to try.
+// This has the potential for job execution order to get out of
+// sync, so we can add timestamps to them at enqueue and sort by
+// timestamp before execution to prevent that.
+//
+// 2/26/21: my current thought for the queuing mechanism is this:
+// main thread allocates a large array(1024? 2048?) of a job_alloc_t.
+// job_desc_t contains two members:
+//  - atomic_int owning_thread;
+//  - job_t job
+// when any thread wants to allocate a new job, they must loop
+// through the array to claim indices by atomic CAS on owning_thread
+// only when owning_thread == 0
+// 
+// when a thread wishes to free a job, they write zero to the
+// owning_thread field.
+//
+// the main thread also allocates a large array (4096?) of job_t* that
+// exists to contain any available jobs. To push a job, the main
+// thread first tries to grab a job_alloc_t from the allocation table.
+// Once an allocation is available, the main thread loops through
+// the available jobs array searching for the next index with a
+// nullptr. An atomic CAS should be performed to write a modified
+// form of the pointer to the found job_alloc_t.
+//
+// a secondary thread in idle execution state is just looping through
+// the available jobs array, trying to snatch up the first non-nullptr
+// found, at which point the job on the other end belongs to it.
+//
+// a similar array exists, owned by the main thread, for placing jobs
+// that are either new or waiting. The same approach is taken with a
+// secondary thread preparing any data into an allocation block and
+// swapping the pointer to that allocation block onto the array at the
+// first nullptr found.
+//
+// the main thread loops through the 'pushed_jobs' array regularly to
+// pull jobs into a 'pending_jobs' queue, or if a job is ready to be
+// run it can be immediately placed onto the 'available_jobs' queue.
+//
+// when any job has completed, the owning thread needs to find a slot
+// in the job_alloc_t table to place it back, ensuring data isn't
+// leaking and that further jobs can be allocated.
+//
+// These job arrays have the following operations:
+//
+// - T* try_take([optional] max_iterations)
+//   tries to take the first available object using CAS
+//   returns nullptr on failure
+//
+// - bool try_give(T* , [optional] max_iterations)
+//   tries to give an object back into the first available nullptr slot
+//   returns false on failure
+//
+// TODO(Wynter): We aren't currently cleaning up job memory. We
+// should check to see if a job has finished executing and
+// potentially free it.
+//
+// TODO(Wynter): In association with job memory free'ing, we can
+// also pool job memory allocations, which would allow us to reuse
+// the chunks instead of having to constantly malloc/free, which
+// could become very costly very quickly.
+void jobs_run(double time) {
+    latest_time = time;
+    uint64_t pass_start = jobs_clock_ns();
+    job_run_depth++;
+
+    job_periodic_fire(time);
+
+    // borrow the thread's reserved ring, a nested jobs_run finds it
+    // taken and grows its own
+    job_ring_t running_jobs;
+    running_jobs.swap(job_running);
+
+    bool run_queueing = true;
+
+    // TODO(Wynter): The below TODO is no longer true as I've
+    // implemented another workaround utilizing a queue of
+    // jobs that have yielded during that run. This does limit
+    // each job to running only once per run. This may not be
+    // an ideal solution in the long run however for the time
+    // being we can just continue to call run as many times as
+    // we want per frame to counter this issue.
+    //
+    // TODO(Wynter): If we don't check for time elapsed at
+    // the end of this loop, jobs could queue themselves
+    // into an endless loop. We could take in a callback
+    // that returns true/false for if the job queueing
+    // system should exit and run that check at the end
+    // of a job burst
+    while(run_queueing) {
+        int total_jobs = 0;
+
+        if(job_worker_index >= 0) {
+            job_inbox_t *inbox = &zero_jobs_inboxes[job_worker_index];
+            job_inbox_lock(inbox);
+            if(jobs.empty()) {
+                jobs.swap(inbox->jobs);
+            }
+            else {
+                while( inbox->jobs.size() ) {
+                    jobs.push( inbox->jobs.front() );
+                    inbox->jobs.pop();
+                }
+            }
+            job_inbox_unlock(inbox);
+        }
+
+        if(job_io_waiters) {
+            job_io_poll(0);
+        }
+
+        int num_jobs = jobs.size();
+        int num_waiting_jobs = waiting_jobs.size();
+        total_jobs += num_jobs + num_waiting_jobs;
+
+//        printf("Running %i/%i jobs after %f\n", num_jobs, num_waiting_jobs, time);
+
+        // running_jobs is empty here, jobs queued while these run go
+        // to the emptied [jobs] for the next round
+        running_jobs.swap(jobs);
+
+        int waiting_size = waiting_jobs.size();
+        for(int i = 0; i < waiting_size; i++) {
+            job_t *waiting_job = waiting_jobs.front();
+            waiting_jobs.pop();
+
+            const job_waiting_t &wait_job = waiting_job->wait;
+            bool still_waiting = false;
+            waiting_job->wait_result = JOB_WAIT_OK;
+
+            switch(wait_job.condition) {
+                case job_waiting_t::JOB_WAIT_TIMER:
+                    if(time >= wait_job.end_time - ZERO_JOBS_TIMING_ERROR) {
+//                        printf("running job at %f awaiting %f\n", time, wait_job.end_time);
+                    }
+                    else {
+//                        printf("waiting job at %f until %f\n", time, wait_job.end_time);
+                        still_waiting = true;
+                    }
+                break;
+                case job_waiting_t::JOB_WAIT_COUNTER_ZERO:
+                    if(!wait_job.data_address || ZERO_ATOMIC_LOAD((ZERO_ATOMIC(int)*)wait_job.data_address) != 0) {
+                        still_waiting = true;
+                    }
+                break;
+                case job_waiting_t::JOB_WAIT_DATA_ZERO:
+                case job_waiting_t::JOB_WAIT_FD:
+                    if(!wait_job.data_address || *(volatile int*)wait_job.data_address != 0) {
+                        still_waiting = true;
+                    }
+                break;
+            }
+
+            if(still_waiting && wait_job.cancellable && job_cancel_requested(waiting_job)) {
+                waiting_job->wait_result = JOB_WAIT_CANCELLED;
+                still_waiting = false;
+            }
+            else if(still_waiting && wait_job.end_time != JOB_WAIT_FOREVER &&
+                    time >= wait_job.end_time - ZERO_JOBS_TIMING_ERROR) {
+                waiting_job->wait_result = JOB_WAIT_TIMED_OUT;
+                still_waiting = false;
+            }
+
+            if(still_waiting) {
+                waiting_jobs.push(waiting_job);
+            }
+            else {
+                running_jobs.push(waiting_job);
+            }
+        }
+
+        if(!running_jobs.size()) {
+            run_queueing = false;
+        }
+        else {
+//            printf("jobs: t[%i], r[%ld], w[%ld]\n",
+//                    total_jobs,
+//                    running_jobs.size(),
+//                    waiting_jobs.size());
+            while( running_jobs.size() ) {
+                job_t *job = running_jobs.front();
+                running_jobs.pop();
+
+                // get the next job's record and saved registers on their
+                // way into the cache while this one runs
+                if(running_jobs.size()) {
+                    job_t *next = running_jobs.front();
+                    ZERO_JOBS_PREFETCH(next);
+                    if(next->fiber) {
+                        ZERO_JOBS_PREFETCH(next->fiber);
+                        ZERO_JOBS_PREFETCH(next->fiber->context);
+                    }
+                }
+
+                uint64_t perf_start[4];
+                bool perf = job_perf_read(perf_start) == 0;
+
+                job->resumes++;
+                job_stats.resumes++;
+                job_worker_slot_t *slot = job_worker_index >= 0 && ZERO_ATOMIC_LOAD(&zero_jobs_watchdog_active)
+                    ? &zero_jobs_worker_slots[job_worker_index] : NULL;
+                if(slot) {
+                    slot->entrypoint = job->entrypoint;
+                    slot->description = job->description;
+                    slot->resumes = job->resumes;
+                    ZERO_ATOMIC_SWAP(&slot->start_ns, jobs_clock_ns());
+                }
+
+                if(!job->fiber) {
+                    if(!job_cancel_requested(job)) {
+                        job_current = job;
+                        job->result = job->entrypoint(job->data);
+                        job_current = nullptr;
+                    }
+                }
+                // cancelled before it ever ran, hand the slot straight
+                // back without switching to the fiber
+                else if(job->fiber->status == ZERO_FIBER_STARTED && job_cancel_requested(job)) {
+                    job->fiber->status = ZERO_FIBER_ENDED;
+                }
+                else {
+                    zero_userdata_t resume_data = job->fiber->status == ZERO_FIBER_STARTED
+                        ? job->data
+                        : (zero_userdata_t)(intptr_t)job->wait_result;
+
+                    job_current = job;
+                    zero_userdata_t returned = zero_fiber_resume(job->fiber, resume_data);
+                    job_current = nullptr;
+
+                    if(!zero_fiber_is_active(job->fiber)) {
+                        job->result = returned;
+                    }
+                }
+
+                if(slot) {
+                    ZERO_ATOMIC_SWAP(&slot->start_ns, (uint64_t)0);
+                }
+
+                if(perf) {
+                    job_perf_record(job, perf_start);
+                }
+
+                if(!zero_fiber_is_active(job->fiber)) {
+                    job_finish(job);
+                }
+            }
+        }
+    }
+    if(jobs.empty()) {
+        jobs.swap(yielded_jobs);
+    }
+    while( yielded_jobs.size() ) {
+        jobs.push(yielded_jobs.front());
+        yielded_jobs.pop();
+    }
+    job_running.swap(running_jobs);
+
+    // a nested pass, or one run by a wait inside the caller's frame,
+    // must not rewind what the frame has allocated so far
+    if(zero_jobs_config.arena_frame_per_run && job_run_depth == 1) {
+        jobs_frame_boundary();
+    }
+    job_run_depth--;
+
+    if(zero_jobs_config.stack_trim_period > 0.0 && job_worker_index == 0) {
+        if(!zero_jobs_trim_ns) {
+            zero_jobs_trim_ns = pass_start;
+        }
+        else if(pass_start - zero_jobs_trim_ns >= (uint64_t)(zero_jobs_config.stack_trim_period * 1e9)) {
+            job_pool_trim();
+            zero_jobs_trim_ns = pass_start;
+        }
+    }
+
+    uint64_t pass_ns = jobs_clock_ns() - pass_start;
+    job_stats.passes++;
+    job_stats.last_pass_ns = pass_ns;
+    job_stats.total_pass_ns += pass_ns;
+    if(pass_ns > job_stats.max_pass_ns) job_stats.max_pass_ns = pass_ns;
+}
+
+static void *job_arena_block_alloc(job_arena_block_t *block, size_t size, size_t align) {
+    uintptr_t base = (uintptr_t)(block + 1);
+    uintptr_t start = (base + block->used + (align - 1)) & ~(uintptr_t)(align - 1);
+
+    if(start + size > base + block->size) {
+        return NULL;
+    }
+
+    block->used = (start + size) - base;
+    return (void*)start;
+}
+
+static void *job_arena_alloc_from(job_arena_t *arena, size_t size, size_t align) {
+    void *memory = NULL;
+
+    // later blocks are only touched once earlier ones are full
+    for(job_arena_block_t *block = arena->current; block; block = block->next) {
+        if((memory = job_arena_block_alloc(block, size, align))) {
+            arena->current = block;
+            return memory;
+        }
+    }
+
+    size_t block_size = ZERO_JOBS_ARENA_SIZE;
+    if(block_size < size + align) {
+        block_size = size + align;
+    }
+
+    job_arena_block_t *block = (job_arena_block_t*) ZERO_JOBS_MALLOC(sizeof(job_arena_block_t) + block_size);
+    if(!block) {
+        return NULL;
+    }
+    block->next = NULL;
+    block->size = block_size;
+    block->used = 0;
+
+    if(arena->current) {
+        job_arena_block_t *tail = arena->current;
+        while(tail->next) tail = tail->next;
+        tail->next = block;
+    }
+    else {
+        arena->first = block;
+    }
+    arena->current = block;
+
+    return job_arena_block_alloc(block, size, align);
+}
+
+// empties [arena] but keeps its blocks for the next use
+static void job_arena_rewind(job_arena_t *arena) {
+    for(job_arena_block_t *block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+static void job_arena_release(job_arena_t *arena) {
+    job_arena_block_t *block = arena->first;
+    while(block) {
+        job_arena_block_t *next = block->next;
+        ZERO_JOBS_FREE(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+// Allocates from the calling worker's arena for the current frame. The
+// memory is released in bulk ZERO_JOBS_ARENA_FRAMES frame boundaries
+// later, never individually. [align] must be a power of two.
+void *job_arena_alloc(size_t size, size_t align) {
+    return job_arena_alloc_from(&job_arenas.frames[job_arena_frame], size, align);
+}
+
+// Ends the calling worker's frame: the next arena in rotation is
+// rewound and becomes the one job_arena_alloc hands out from.
+void jobs_frame_boundary() {
+    job_arena_frame = (job_arena_frame + 1) % ZERO_JOBS_ARENA_FRAMES;
+    job_arena_rewind(&job_arenas.frames[job_arena_frame]);
+}
+
+// monotonic, unaffected by the time passed to jobs_run
+uint64_t jobs_clock_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// [polling] is set if a job waits on a condition only a poll can see change
+static double job_next_deadline(bool *polling) {
+    *polling = false;
+    job_periodic_sweep();
+    if(jobs.size() || yielded_jobs.size()) {
+        return latest_time;
+    }
+
+    double deadline = job_periodic_heap.empty() ? JOB_WAIT_FOREVER : job_periodic_heap.front()->next_time;
+
+    size_t waiting_size = waiting_jobs.size();
+    for(size_t i = 0; i < waiting_size; i++) {
+        const job_waiting_t &wait = waiting_jobs.at(i)->wait;
+
+        // fd waits are woken by epoll rather than polled
+        if(wait.condition != job_waiting_t::JOB_WAIT_TIMER && wait.condition != job_waiting_t::JOB_WAIT_FD) {
+            *polling = true;
+        }
+        if(wait.end_time != JOB_WAIT_FOREVER && (deadline == JOB_WAIT_FOREVER || wait.end_time < deadline)) {
+            deadline = wait.end_time;
+        }
+    }
+    return deadline;
+}
+
+// jobs_clock_ns in seconds, the time jobs_run_until_idle runs jobs at
+double jobs_clock() {
+    return (double)jobs_clock_ns() / 1000000000.0;
+}
+
+// The earliest time a job waiting on the calling thread times out or
+// its timer fires, in the time passed to jobs_run. The current time if
+// jobs are ready to run, JOB_WAIT_FOREVER if nothing has a deadline.
+double jobs_next_deadline() {
+    bool polling;
+    return job_next_deadline(&polling);
+}
+
+static job_waker_t *job_waker_current() {
+    return job_worker_index >= 0 ? &zero_jobs_wakers[job_worker_index] : &job_waker;
+}
+
+static bool job_inbox_empty() {
+    if(job_worker_index < 0) return true;
+
+    job_inbox_t *inbox = &zero_jobs_inboxes[job_worker_index];
+    job_inbox_lock(inbox);
+    bool empty = inbox->jobs.empty();
+    job_inbox_unlock(inbox);
+    return empty;
+}
+
+// jobs_run_until_idle's sleep while jobs are parked on the reactor:
+// epoll_wait until [until] instead of the condition variable, a wake
+// arrives through the eventfd
+static void job_io_sleep(job_waker_t *waker, std::chrono::steady_clock::time_point until) {
+    int timeout_ms = -1;
+    if(until != std::chrono::steady_clock::time_point::max()) {
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(until - std::chrono::steady_clock::now()).count();
+        timeout_ms = left > 0 ? (int)((left + 999) / 1000) : 0;
+    }
+
+    ZERO_ATOMIC_SWAP(&waker->sleeping, 1);
+    // see jobs_run_until_idle, a push that saw sleeping == 0 is caught here
+    if(job_inbox_empty()) {
+        job_io_poll(timeout_ms);
+    }
+    ZERO_ATOMIC_SWAP(&waker->sleeping, 0);
+
+    std::lock_guard<std::mutex> lock(waker->lock);
+    waker->woken = false;
+}
+
+// Sleeps until [until], a jobs_wake or a job landing in the inbox.
+static void job_idle_sleep(job_waker_t *waker, std::chrono::steady_clock::time_point until) {
+    if(job_io_waiters) {
+        job_io_sleep(waker, until);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(waker->lock);
+    ZERO_ATOMIC_SWAP(&waker->sleeping, 1);
+    // a job pushed between the pass and taking the lock has already
+    // seen sleeping == 0, check the inbox once more under the lock
+    if(job_inbox_empty()) {
+        if(until == std::chrono::steady_clock::time_point::max()) {
+            waker->signal.wait(lock, [waker] { return waker->woken; });
+        }
+        else {
+            waker->signal.wait_until(lock, until, [waker] { return waker->woken; });
+        }
+    }
+    waker->woken = false;
+    ZERO_ATOMIC_SWAP(&waker->sleeping, 0);
+}
+
+// Runs the calling thread's jobs at jobs_clock() time, sleeping when
+// none are ready until the next deadline or until jobs_wake is called
+// for this worker. Jobs pushed to this worker from another thread wake
+// it by themselves. Waits on counters and addresses are polled every
+// ZERO_JOBS_IDLE_POLL_NS. Returns once no jobs are left, or if [stop]
+// is given, keeps serving until *stop is set and the worker is woken.
+void jobs_run_until_idle(ZERO_ATOMIC(int) *stop) {
+    job_waker_t *waker = job_waker_current();
+
+    for(;;) {
+        jobs_run(jobs_clock());
+
+        if(stop && ZERO_ATOMIC_LOAD(stop)) {
+            return;
+        }
+
+        bool polling;
+        double deadline = job_next_deadline(&polling);
+        if(deadline != JOB_WAIT_FOREVER && deadline <= jobs_clock()) {
+            continue;
+        }
+        if(!stop && deadline == JOB_WAIT_FOREVER && waiting_jobs.empty() && job_inbox_empty()) {
+            return;
+        }
+
+        auto until = std::chrono::steady_clock::time_point::max();
+        if(deadline != JOB_WAIT_FOREVER) {
+            until = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds((uint64_t)(deadline * 1000000000.0))));
+        }
+        if(polling) {
+            auto poll = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ZERO_JOBS_IDLE_POLL_NS);
+            if(poll < until) until = poll;
+        }
+
+        job_idle_sleep(waker, until);
+    }
+}
+
+// Time base of a caller outside of any job that runs the calling
+// thread's jobs while it waits on them, see job_pump.
+struct job_pump_t {
+    double time;
+    double clock;
+};
+
+static job_pump_t job_pump_begin() {
+    job_pump_t pump = { latest_time, jobs_clock() };
+    return pump;
+}
+
+// One pass of the calling thread's jobs for a waiter outside of any
+// job. The time passed to jobs_run moves on with the real clock from
+// where the caller left it, so timers the jobs set come due. When
+// nothing is ready the thread sleeps until the next deadline or a
+// wake, but no longer than ZERO_JOBS_IDLE_POLL_NS since what the
+// caller waits on may change on another worker without a wake.
+// [counter] is what the caller waits to see zero, if the pass got it
+// there the thread doesn't sleep.
+static void job_pump(const job_pump_t *pump, ZERO_ATOMIC(int) *counter) {
+    double time = pump->time + (jobs_clock() - pump->clock);
+    job_run_depth++;
+    jobs_run(time > latest_time ? time : latest_time);
+    job_run_depth--;
+    if(counter && ZERO_ATOMIC_LOAD(counter) == 0) {
+        return;
+    }
+
+    bool polling;
+    double deadline = job_next_deadline(&polling);
+    if(deadline != JOB_WAIT_FOREVER && deadline <= latest_time) {
+        return;
+    }
+
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ZERO_JOBS_IDLE_POLL_NS);
+    if(deadline != JOB_WAIT_FOREVER) {
+        // the deadline is in the caller's time base
+        auto due = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::nanoseconds((uint64_t)((pump->clock + deadline - pump->time) * 1000000000.0))));
+        if(due < until) until = due;
+    }
+    job_idle_sleep(job_waker_current(), until);
+}
+
+// Wakes [worker] from jobs_run_until_idle, or every worker if [worker]
+// is -1. A wake sent while the worker is busy makes its next sleep
+// return at once.
+void jobs_wake(int worker) {
+    for(int i = 0; i < ZERO_JOBS_MAX_WORKERS; i++) {
+        if(worker >= 0 && i != worker) continue;
+
+        job_waker_t *waker = &zero_jobs_wakers[i];
+        {
+            std::lock_guard<std::mutex> lock(waker->lock);
+            waker->woken = true;
+        }
+        waker->signal.notify_one();
+#if ZERO_ATOMIC_LINUX
+        if(waker->io_event >= 0) {
+            uint64_t one = 1;
+            ssize_t written = write(waker->io_event, &one, sizeof(one));
+            (void)written;
+        }
+#endif
+    }
+}
+
+void jobs_stats(jobs_stats_t *stats) {
+    *stats = job_stats;
+}
+
+void jobs_stats_reset() {
+    memset(&job_stats, 0, sizeof(job_stats));
+}
+
+#if ZERO_ATOMIC_LINUX && defined(ZERO_FIBER_X86_64)
+// runs on the stalled worker, walks the stack of whatever it is running
+static void job_watchdog_signal(int signal, siginfo_t *info, void *ucontext) {
+    (void)signal;
+    (void)info;
+    if(job_worker_index < 0) return;
+
+    job_worker_slot_t *slot = &zero_jobs_worker_slots[job_worker_index];
+    const mcontext_t *mcontext = &((ucontext_t*)ucontext)->uc_mcontext;
+    void *low = NULL, *high = NULL;
+
+    slot->stack[0] = (void*)mcontext->gregs[REG_RIP];
+    slot->depth = 1;
+    if(zero_fiber_stack_bounds(zero_fiber_running(), &low, &high) == 0) {
+        slot->depth += zero_fiber_frame_walk((void*)mcontext->gregs[REG_RBP], low, high,
+                                             slot->stack + 1, ZERO_JOBS_WATCHDOG_DEPTH - 1);
+    }
+    ZERO_ATOMIC_SWAP(&slot->stack_ready, 1);
+}
+#endif
+
+static void job_watchdog_report(const job_stall_t *stall, void *userdata) {
+    (void)userdata;
+    fprintf(stderr, "zero_jobs: worker %i stuck in job %s (%p) for %.3f ms, resume %u\n",
+            stall->worker, stall->description ? stall->description : "?", (void*)stall->entrypoint,
+            (double)stall->running_ns / 1000000.0, stall->resumes);
+    for(int i = 0; i < stall->depth; i++) {
+        fprintf(stderr, "    #%i %p\n", i, stall->stack[i]);
+    }
+}
+
+static void job_watchdog_loop(uint64_t threshold_ns, job_stall_callback_t callback, void *userdata, int capture_stack) {
+    // the start time each worker was last reported for, so every stall
+    // is reported once
+    uint64_t reported[ZERO_JOBS_MAX_WORKERS] = { 0 };
+    uint64_t interval_ns = threshold_ns / 4 > 1000000 ? threshold_ns / 4 : 1000000;
+
+    while(ZERO_ATOMIC_LOAD(&zero_jobs_watchdog_active)) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(interval_ns));
+        uint64_t now = jobs_clock_ns();
+
+        for(int worker = 0; worker < ZERO_JOBS_MAX_WORKERS; worker++) {
+            job_worker_slot_t *slot = &zero_jobs_worker_slots[worker];
+            uint64_t start = ZERO_ATOMIC_LOAD(&slot->start_ns);
+            if(!start || start == reported[worker] || now - start < threshold_ns) continue;
+
+            job_stall_t stall;
+            stall.worker = worker;
+            stall.entrypoint = slot->entrypoint;
+            stall.description = slot->description;
+            stall.resumes = slot->resumes;
+            stall.running_ns = now - start;
+            stall.depth = 0;
+
+#if ZERO_ATOMIC_LINUX && defined(ZERO_FIBER_X86_64)
+            if(capture_stack) {
+                ZERO_ATOMIC_SWAP(&slot->stack_ready, 0);
+                if(pthread_kill(zero_jobs_worker_threads[worker], ZERO_JOBS_WATCHDOG_SIGNAL) == 0) {
+                    uint64_t give_up = jobs_clock_ns() + 10000000;
+                    while(!ZERO_ATOMIC_LOAD(&slot->stack_ready) && jobs_clock_ns() < give_up) {
+                        std::this_thread::yield();
+                    }
+                }
+                if(ZERO_ATOMIC_LOAD(&slot->stack_ready)) {
+                    stall.depth = slot->depth;
+                    memcpy(stall.stack, slot->stack, sizeof(void*) * slot->depth);
+                }
+            }
+#else
+            (void)capture_stack;
+#endif
+
+            // the job may have moved on while the fields were copied
+            if(ZERO_ATOMIC_LOAD(&slot->start_ns) != start) continue;
+
+            reported[worker] = start;
+            callback(&stall, userdata);
+        }
+    }
+}
+
+// Starts a thread that reports jobs running on a worker for longer
+// than [threshold_ns] without yielding, through [callback] or to
+// stderr when it is NULL. The callback runs on the watchdog thread.
+// With [capture_stack] the stalled worker is briefly interrupted with
+// ZERO_JOBS_WATCHDOG_SIGNAL to walk its stack. Only threads that
+// entered as a worker are watched.
+int jobs_watchdog_start(uint64_t threshold_ns, job_stall_callback_t callback, void *userdata, int capture_stack) {
+    if(!threshold_ns || ZERO_ATOMIC_LOAD(&zero_jobs_watchdog_active)) {
+        return -1;
+    }
+
+#if ZERO_ATOMIC_LINUX && defined(ZERO_FIBER_X86_64)
+    if(capture_stack) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = job_watchdog_signal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if(sigaction(ZERO_JOBS_WATCHDOG_SIGNAL, &action, NULL) != 0) return -1;
+    }
+#endif
+
+    ZERO_ATOMIC_SWAP(&zero_jobs_watchdog_active, 1);
+    zero_jobs_watchdog_thread = std::thread(job_watchdog_loop, threshold_ns,
+                                            callback ? callback : job_watchdog_report, userdata, capture_stack);
+    return 0;
+}
+
+void jobs_watchdog_stop() {
+    if(!ZERO_ATOMIC_LOAD(&zero_jobs_watchdog_active)) return;
+
+    ZERO_ATOMIC_SWAP(&zero_jobs_watchdog_active, 0);
+    zero_jobs_watchdog_thread.join();
+
+    for(int worker = 0; worker < ZERO_JOBS_MAX_WORKERS; worker++) {
+        ZERO_ATOMIC_SWAP(&zero_jobs_worker_slots[worker].start_ns, (uint64_t)0);
+    }
+}
+
+// Starts counting cycles, instructions, cache and branch misses around
+// every job the calling thread runs. Each worker that should be
+// measured calls this itself. Returns the JOB_PERF_* counters that
+// could be opened, 0 if perf events aren't supported or permitted
+// (see /proc/sys/kernel/perf_event_paranoid), in which case jobs run
+// as usual and nothing is recorded.
+int jobs_perf_enable() {
+#if ZERO_ATOMIC_LINUX
+    static const struct { unsigned int counter; uint64_t config; } events[4] = {
+        { JOB_PERF_CYCLES,        PERF_COUNT_HW_CPU_CYCLES },
+        { JOB_PERF_INSTRUCTIONS,  PERF_COUNT_HW_INSTRUCTIONS },
+        { JOB_PERF_CACHE_MISSES,  PERF_COUNT_HW_CACHE_MISSES },
+        { JOB_PERF_BRANCH_MISSES, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    if(job_perf_fds[0] >= 0) {
+        jobs_perf_disable();
+    }
+
+    int opened = 0;
+    for(int i = 0; i < 4; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = job_perf_count == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, job_perf_fds[0], PERF_FLAG_FD_CLOEXEC);
+        if(fd < 0) continue;
+
+        job_perf_fds[job_perf_count] = fd;
+        job_perf_order[job_perf_count++] = events[i].counter;
+        opened |= events[i].counter;
+    }
+
+    if(job_perf_count) {
+        ioctl(job_perf_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    return opened;
+#else
+    return 0;
+#endif
+}
+
+void jobs_perf_disable() {
+#if ZERO_ATOMIC_LINUX
+    for(int i = 0; i < job_perf_count; i++) {
+        close(job_perf_fds[i]);
+        job_perf_fds[i] = -1;
+    }
+#endif
+    job_perf_count = 0;
+}
+
+// Copies up to [max_stats] entries, from every thread, into [stats] and
+// returns how many were copied.
+int jobs_perf_stats(job_perf_stats_t *stats, int max_stats) {
+    int count = 0;
+
+    job_spin_lock(&zero_jobs_perf_lock);
+    for(size_t i = 0; i < ZERO_JOBS_PERF_ENTRIES && count < max_stats; i++) {
+        if(zero_jobs_perf_table[i].runs) {
+            stats[count++] = zero_jobs_perf_table[i];
+        }
+    }
+    job_spin_unlock(&zero_jobs_perf_lock);
+
+    return count;
+}
+
+void jobs_perf_reset() {
+    job_spin_lock(&zero_jobs_perf_lock);
+    memset(zero_jobs_perf_table, 0, sizeof(zero_jobs_perf_table));
+    job_spin_unlock(&zero_jobs_perf_lock);
+}
+
+// one line per entry with IPC and misses per thousand instructions
+void jobs_perf_print(FILE *out) {
+    job_perf_stats_t stats[ZERO_JOBS_PERF_ENTRIES];
+    int count = jobs_perf_stats(stats, ZERO_JOBS_PERF_ENTRIES);
+
+    for(int i = 0; i < count; i++) {
+        job_perf_stats_t *entry = &stats[i];
+        double instructions = (double)entry->instructions;
+        double per_k = instructions > 0.0 ? 1000.0 / instructions : 0.0;
+
+        if(entry->description) {
+            fprintf(out, "%-32s", entry->description);
+        }
+        else {
+            fprintf(out, "%-32p", (void*)entry->entrypoint);
+        }
+        fprintf(out, " runs %8llu  cycles %12llu  ipc %5.2f  cache-miss/k %7.2f  branch-miss/k %7.2f\n",
+                (unsigned long long)entry->runs,
+                (unsigned long long)entry->cycles,
+                entry->cycles ? instructions / (double)entry->cycles : 0.0,
+                (double)entry->cache_misses * per_k,
+                (double)entry->branch_misses * per_k);
+    }
+}
+
+// prefer a job_group_t on the stack, counters made here must be
+// released with job_counter_free
+ZERO_ATOMIC(int) *job_counter_make() {
+    return new ZERO_ATOMIC(int)(0);
+}
+
+void job_counter_free(ZERO_ATOMIC(int) *counter) {
+    delete counter;
+}
+
+// Maps [size] bytes for fiber stacks, rounded up to whole huge pages.
+// Explicit huge pages only exist if the admin reserved some, so a
+// failed MAP_HUGETLB is the common case and the slab is then mapped
+// with small pages, aligned by hand, and offered to THP. Returns NULL
+// if neither works, the caller falls back to malloc.
+static char *job_stack_slab(size_t size, enum job_stack_backing_t *backing) {
+#if ZERO_ATOMIC_LINUX
+    const size_t page = ZERO_JOBS_HUGE_PAGE_SIZE;
+    size = (size + page - 1) & ~(page - 1);
+
+#ifdef MAP_HUGETLB
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(memory != MAP_FAILED) {
+        *backing = JOB_STACKS_HUGETLB;
+        return (char*)memory;
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    // THP only backs 2 MiB aligned ranges, over-map and trim the ends
+    char *mapped = (char*)mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapped == (char*)MAP_FAILED) {
+        return NULL;
+    }
+
+    char *slab = (char*)(((uintptr_t)mapped + page - 1) & ~(uintptr_t)(page - 1));
+    if(slab > mapped) munmap(mapped, slab - mapped);
+    if(slab + size < mapped + size + page) munmap(slab + size, mapped + size + page - (slab + size));
+
+    if(madvise(slab, size, MADV_HUGEPAGE) != 0) {
+        munmap(slab, size);
+        return NULL;
+    }
+    *backing = JOB_STACKS_THP;
+    return slab;
+#endif
+#endif
+    (void)size;
+    (void)backing;
+    return NULL;
+}
+
+// the fiber for pool slot [slot], from [slab] if there is one
+static zero_fiber_t *job_pool_fiber(char *slab, size_t slot, size_t stack_size) {
+    if(slab) {
+        return zero_fiber_make_in(slab + slot * stack_size, stack_size, "", NULL, NULL);
+    }
+    return zero_fiber_make("", stack_size, NULL, NULL);
+}
+
+// what [pool]'s fiber stacks were allocated from, JOB_STACKS_MIXED if
+// it grew chunks on different ones
+enum job_stack_backing_t jobs_stack_backing(enum job_pool_kind_t pool) {
+    return zero_jobs_pools[pool].backing;
+}
+
+static int job_pool_limit(enum job_pool_kind_t kind) {
+    const job_pool_t *pool = &zero_jobs_pools[kind];
+    int limit = zero_jobs_config.pool_limits[kind];
+    int most = pool->chunk * ZERO_JOBS_POOL_MAX_CHUNKS;
+    return limit < pool->chunk ? pool->chunk : limit > most ? most : limit;
+}
+
+// Adds a chunk of jobs to [kind] unless that would take it past its
+// limit. [seen] is the capacity the caller found full, if another
+// thread grew the pool since then there is nothing to do. Returns -1
+// if the pool can't grow.
+static int job_pool_grow(enum job_pool_kind_t kind, int seen) {
+    job_pool_t *pool = &zero_jobs_pools[kind];
+    job_spin_lock(&pool->growing);
+
+    int capacity = ZERO_ATOMIC_LOAD(&pool->capacity);
+    if(capacity != seen) {
+        job_spin_unlock(&pool->growing);
+        return 0;
+    }
+
+    job_t *records = capacity + pool->chunk <= job_pool_limit(kind) ?
+        (job_t*) ZERO_JOBS_MALLOC(pool->chunk * sizeof(job_t)) : NULL;
+    if(!records) {
+        job_spin_unlock(&pool->growing);
+        return -1;
+    }
+    memset(records, 0, pool->chunk * sizeof(job_t));
+
+    // each slab slot holds a fiber header followed by its stack, so
+    // slab fibers get a stack a header smaller than malloc'd ones
+    char *slab = NULL;
+    enum job_stack_backing_t backing = JOB_STACKS_MALLOC;
+    if(pool->stack_size && zero_jobs_config.huge_page_stacks) {
+        slab = job_stack_slab(pool->chunk * pool->stack_size, &backing);
+    }
+
+    for(int slot = 0; slot < pool->chunk; slot++) {
+        job_t *job = &records[slot];
+        job->pool = kind;
+        if(kind == JOB_POOL_SHARED) {
+            job->fiber = zero_fiber_make_shared("", NULL, NULL);
+        }
+        else if(pool->stack_size) {
+            job->fiber = job_pool_fiber(slab, slot, pool->stack_size);
+        }
+        job->stack_backing = backing;
+        pool->table[capacity + slot] = job;
+    }
+    pool->backing = !capacity || pool->backing == backing ? backing : JOB_STACKS_MIXED;
+
+    // the new slots are only scanned once their jobs are set up
+    ZERO_ATOMIC_SWAP(&pool->capacity, capacity + pool->chunk);
+    job_spin_unlock(&pool->growing);
+    return 0;
+}
+
+static void job_pool_setup(enum job_pool_kind_t kind, int chunk, size_t stack_size) {
+    job_pool_t *pool = &zero_jobs_pools[kind];
+    size_t slots = (size_t)chunk * ZERO_JOBS_POOL_MAX_CHUNKS;
+
+    pool->table = (ZERO_ATOMIC(job_t*)*) ZERO_JOBS_MALLOC(slots * sizeof(job_t*));
+    memset((void*)pool->table, 0, slots * sizeof(job_t*));
+    pool->chunk = chunk;
+    pool->stack_size = stack_size;
+    job_pool_grow(kind, 0);
+}
+
+// the calling thread becomes worker 0, the main thread
+int job_pool_init() {
+    jobs_worker_enter(0);
+
+    if(zero_jobs_pools[JOB_POOL_SMALL].table) {
+        return 0;
+    }
+
+    job_pool_setup(JOB_POOL_SMALL, ZERO_JOBS_SMALL_COUNT, ZERO_JOBS_SMALL_SIZE);
+    job_pool_setup(JOB_POOL_LARGE, ZERO_JOBS_LARGE_COUNT, ZERO_JOBS_LARGE_SIZE);
+    job_pool_setup(JOB_POOL_INLINE, ZERO_JOBS_INLINE_COUNT, 0);
+    job_pool_setup(JOB_POOL_SHARED, ZERO_JOBS_SHARED_COUNT, 0);
+    return 0;
+}
+
+// the slots of [pool] in use so far, the table may grow past [count]
+// but what it holds below that never moves
+static ZERO_ATOMIC(job_t*) *job_pool_table(enum job_pool_kind_t pool, size_t *count) {
+    *count = (size_t) ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].capacity);
+    return zero_jobs_pools[pool].table;
+}
+
+// a job_alloc_from caller held back by a full pool
+struct job_pool_wait_t {
+    bool waiting;
+    job_pump_t pump;
+};
+
+// Called when [pool] is full and at its limit. A pool given a limit
+// in jobs_config_t makes the caller wait for a slot, a fiber job
+// yields and a thread outside of any job pumps its own jobs through
+// job_pump, sleeping until a slot is freed or a timer is due, so some
+// can finish. Returns -1 if the caller gets NULL instead, for pools
+// without a limit, waits past jobs_config_t::pool_wait_timeout, inline
+// jobs that can't switch away and cancelled jobs.
+static int job_pool_backpressure(enum job_pool_kind_t pool, job_pool_wait_t *wait) {
+    double timeout = zero_jobs_config.pool_wait_timeout;
+    if(!zero_jobs_config.pool_limits[pool] || timeout < 0) {
+        return -1;
+    }
+
+    if(!wait->waiting) {
+        wait->waiting = true;
+        wait->pump = job_pump_begin();
+    }
+    else if(timeout > 0 && jobs_clock() - wait->pump.clock >= timeout) {
+        return -1;
+    }
+
+    if(job_current) {
+        if(!job_current->fiber || job_yield() == JOB_WAIT_CANCELLED) {
+            return -1;
+        }
+        return 0;
+    }
+
+    ZERO_ATOMIC_INCREMENT(&zero_jobs_pools[pool].waiting);
+    job_pump(&wait->pump, NULL);
+    ZERO_ATOMIC_DECREMENT(&zero_jobs_pools[pool].waiting);
+    return 0;
+}
+
+// raises [mark] to [value] unless it is already higher
+static void job_pool_raise(ZERO_ATOMIC(int) *mark, int value) {
+    int seen;
+    while((seen = ZERO_ATOMIC_LOAD(mark)) < value && ZERO_ATOMIC_CAS(mark, seen, value) != seen) {
+    }
+}
+
+static void job_pool_count_out(enum job_pool_kind_t pool) {
+    ZERO_ATOMIC_INCREMENT(&zero_jobs_pools[pool].used);
+    int used = ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].used);
+    job_pool_raise(&zero_jobs_pools[pool].window_high, used);
+    job_pool_raise(&zero_jobs_pools[pool].high_water, used);
+}
+
+// puts [job] in the first empty slot of [table]
+static void job_pool_put(ZERO_ATOMIC(job_t*) *table, size_t count, job_t *job) {
+    // we can use CAS here because if a slot isn't nullptr, nothing is written
+    for(size_t slot = 0; slot < count; slot++) {
+        if( ZERO_ATOMIC_LOAD(&table[slot]) == NULL) {
+            if(ZERO_ATOMIC_CAS(&table[slot], (job_t*) NULL, job) == NULL) {
+                return;
+            }
+        }
+    }
+}
+
+// claims the first free slot in [pool] and resets it for a new job
+static job_t* job_alloc_from(enum job_pool_kind_t pool, zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    job_t* job = NULL;
+    job_pool_wait_t wait = {};
+
+    // scans the slots in use, then grows the pool or waits for a slot
+    // and scans again
+    for(;;) {
+        size_t count = 0;
+        ZERO_ATOMIC(job_t*) *table = job_pool_table(pool, &count);
+
+        for(size_t slot = 0; slot < count; slot++) {
+            if( (job = (job_t*) ZERO_ATOMIC_LOAD(&table[slot])) != NULL) {
+                if(ZERO_ATOMIC_CAS(&table[slot], job, (job_t*) NULL) == job) {
+                    job_pool_count_out(pool);
+                    if(job->stack_trimmed) {
+                        job->stack_trimmed = 0;
+                        ZERO_ATOMIC_DECREMENT(&zero_jobs_pools[pool].trimmed);
+                    }
+                    if(job->fiber) {
+                        // also clears the fiber-local slots the last job left,
+                        // and rewrites the entry frame a trimmed stack lost
+                        zero_fiber_reset(job->fiber, entrypoint, data);
+                        job->fiber->description = "";
+                    }
+                    job->entrypoint = entrypoint;
+                    job->pool = pool;
+                    job->status_counter = nullptr;
+                    job->affinity = JOB_AFFINITY_ANY;
+                    job->data = data;
+                    job->cancelled = 0;
+                    job->wait_result = JOB_WAIT_OK;
+                    job->group = nullptr;
+                    job->description = nullptr;
+                    job->resumes = 0;
+                    job->capture_destroy = nullptr;
+                    job->capture_block = nullptr;
+                    job->result = nullptr;
+                    job->handle_state = JOB_HANDLE_NONE;
+                    // memset(job->fiber->context, 0, job->fiber->stack_size);
+                    return job;
+                }
+            }
+        }
+
+        if(job_pool_grow(pool, (int)count) != 0 && job_pool_backpressure(pool, &wait) != 0) {
+            return NULL;
+        }
+    }
+}
+
+//
+job_t* job_alloc(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    return job_alloc_from(JOB_POOL_SMALL, entrypoint, data);
+}
+
+//
+job_t* job_alloc_large(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    return job_alloc_from(JOB_POOL_LARGE, entrypoint, data);
+}
+
+//
+job_t* job_alloc_inline(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    return job_alloc_from(JOB_POOL_INLINE, entrypoint, data);
+}
+
+//
+job_t* job_alloc_shared(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    return job_alloc_from(JOB_POOL_SHARED, entrypoint, data);
+}
+
+// An inline job record of its own from ZERO_JOBS_MALLOC, for callers
+// that can't be turned away once the inline pool is exhausted. It
+// doesn't count against any pool and job_free hands it back to the
+// heap. Returns NULL if the allocation fails.
+job_t* job_alloc_heap(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    job_t *job = (job_t*) ZERO_JOBS_MALLOC(sizeof(job_t));
+    if(!job) {
+        return NULL;
+    }
+
+    memset(job, 0, sizeof(job_t));
+    job->entrypoint = entrypoint;
+    job->pool = JOB_POOL_HEAP;
+    job->affinity = JOB_AFFINITY_ANY;
+    job->data = data;
+    job->wait_result = JOB_WAIT_OK;
+    job->handle_state = JOB_HANDLE_NONE;
+    return job;
+}
+
+//
+void job_free(job_t* job) {
+    if(job->capture_destroy) {
+        job->capture_destroy(job->data);
+        job->capture_destroy = NULL;
+    }
+    if(job->capture_block) {
+        ZERO_JOBS_FREE(job->capture_block);
+        job->capture_block = NULL;
+    }
+
+    if(job->pool == JOB_POOL_HEAP) {
+        ZERO_JOBS_FREE(job);
+        return;
+    }
+
+    ZERO_ATOMIC_INCREMENT(&job->generation);
+    job->entrypoint = NULL;
+    if(job->fiber) {
+        job->fiber->entrypoint = NULL;
+    }
+
+    size_t count = 0;
+    ZERO_ATOMIC(job_t*)* table = job_pool_table(job->pool, &count);
+
+    ZERO_ATOMIC_DECREMENT(&zero_jobs_pools[job->pool].used);
+    job_pool_put(table, count, job);
+
+    if(ZERO_ATOMIC_LOAD(&zero_jobs_pools[job->pool].waiting)) {
+        jobs_wake(-1);
+    }
+}
+
+// Drops the physical pages behind [fiber]'s stack, the virtual range
+// stays so the slot is reused without a new allocation. The pages come
+// back zeroed on first touch, and zero_fiber_reset rewrites everything
+// a fresh start needs. Only whole pages inside the stack are dropped,
+// so the fiber header and malloc's bookkeeping next to it are kept.
+static size_t job_stack_release(zero_fiber_t *fiber) {
+#if ZERO_ATOMIC_LINUX
+    void *low = NULL, *high = NULL;
+    if(zero_fiber_stack_bounds(fiber, &low, &high) != 0) {
+        return 0;
+    }
+
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)low + page - 1) & ~(page - 1);
+    uintptr_t end = (uintptr_t)high & ~(page - 1);
+    if(end <= begin || madvise((void*)begin, end - begin, MADV_DONTNEED) != 0) {
+        return 0;
+    }
+    return end - begin;
+#else
+    (void)fiber;
+    return 0;
+#endif
+}
+
+// Releases the stacks of the small and large pools that weren't needed
+// since the last trim. Each pool keeps as many resident stacks as it
+// had jobs out at its busiest since then, and because freed jobs go to
+// the lowest free slot those are the ones nearest the front of the
+// table, the ones job_alloc hands out first. Slots are taken out of
+// the table while their stack is released, so allocation carries on
+// concurrently. Stacks carved out of huge page slabs are kept. Returns
+// the bytes handed back.
+size_t job_pool_trim() {
+    static const enum job_pool_kind_t pools[] = { JOB_POOL_SMALL, JOB_POOL_LARGE };
+    size_t released = 0;
+
+    if(!zero_jobs_pools[JOB_POOL_SMALL].table) {
+        return 0;
+    }
+
+    for(enum job_pool_kind_t pool : pools) {
+        size_t count = 0;
+        ZERO_ATOMIC(job_t*) *table = job_pool_table(pool, &count);
+        int used = ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].used);
+        int keep = ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].window_high) - used;
+        ZERO_ATOMIC_SWAP(&zero_jobs_pools[pool].window_high, used);
+
+        for(size_t slot = 0; slot < count; slot++) {
+            job_t *job = (job_t*) ZERO_ATOMIC_LOAD(&table[slot]);
+            if(!job) {
+                continue;
+            }
+            if(keep > 0) {
+                keep--;
+                continue;
+            }
+            // explicit huge pages can only be dropped whole, and stay
+            // reserved for the pool's next burst anyway. Dropping part of
+            // a transparent one splits it into small pages, which undoes
+            // what the slab was for.
+            if(job->stack_backing != JOB_STACKS_MALLOC) {
+                continue;
+            }
+            if(job->stack_trimmed || ZERO_ATOMIC_CAS(&table[slot], job, (job_t*) NULL) != job) {
+                continue;
+            }
+
+            size_t bytes = job_stack_release(job->fiber);
+            if(bytes) {
+                released += bytes;
+                job->stack_trimmed = 1;
+                ZERO_ATOMIC_INCREMENT(&zero_jobs_pools[pool].trimmed);
+            }
+            job_pool_put(table, count, job);
+        }
+    }
+    return released;
+}
+
+void job_pool_stats(enum job_pool_kind_t pool, job_pool_stats_t *stats) {
+    size_t count = 0;
+    job_pool_table(pool, &count);
+
+    stats->capacity = (int)count;
+    stats->limit = zero_jobs_pools[pool].table ? job_pool_limit(pool) : 0;
+    stats->in_use = ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].used);
+    stats->high_water = ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].high_water);
+    stats->resident = (int)count - ZERO_ATOMIC_LOAD(&zero_jobs_pools[pool].trimmed);
+}
+
+// attaches a freshly allocated job to its counter or group and queues it
+static job_t* job_submit(job_t *job, ZERO_ATOMIC(int) *counter, struct job_group_t *group, job_affinity_t affinity) {
+    if(!job) {
+        return NULL;
+    }
+
+    job->affinity = affinity;
+    job->group = group;
+
+    if(counter) {
+        job->status_counter = counter;
+        ZERO_ATOMIC_INCREMENT(job->status_counter);
+    } else {
+        job->status_counter = nullptr;
+    }
+
+    job_push(job);
+    return job;
+}
+
+// Takes a pooled fiber for the job and queues it. The returned job_t*
+// can be passed to job_cancel until the job finishes, after which the
+// slot goes back to the pool. Returns NULL if the pool is exhausted.
+// void job_create(zero_entrypoint_t job_entrypoint, std::atomic<int> *counter) {
+job_t* job_create(zero_entrypoint_t job_entrypoint, ZERO_ATOMIC(int) *counter, job_affinity_t affinity) {
+    return job_submit(job_alloc(job_entrypoint, NULL), counter, nullptr, affinity);
+}
+
+static void job_hold(job_t *job, job_handle_t *handle) {
+    job->handle_state = JOB_HANDLE_HELD;
+    handle->job = job;
+    handle->generation = ZERO_ATOMIC_LOAD(&job->generation);
+}
+
+static bool job_handle_valid(job_handle_t handle) {
+    return handle.job && ZERO_ATOMIC_LOAD(&handle.job->generation) == handle.generation;
+}
+
+// Takes a job from [pool] for a closure, moving it into the record or
+// a malloc'd block the job frees, see the job_create template.
+job_t* job_create_capture(enum job_pool_kind_t pool, zero_entrypoint_t thunk, void (*move)(void*, void*), void (*destroy)(void*),
+                          void *closure, size_t size, size_t align, ZERO_ATOMIC(int) *counter, job_affinity_t affinity,
+                          job_handle_t *handle) {
+    job_t *job = job_alloc_from(pool, thunk, NULL);
+    if(!job) {
+        return NULL;
+    }
+
+    void *storage = job->capture;
+    if(size > ZERO_JOBS_CAPTURE_SIZE || align > 16) {
+        // over-allocated so the closure can be aligned past what
+        // malloc promises
+        job->capture_block = ZERO_JOBS_MALLOC(size + align - 1);
+        if(!job->capture_block) {
+            job_free(job);
+            return NULL;
+        }
+        storage = (void*)(((uintptr_t)job->capture_block + align - 1) & ~(uintptr_t)(align - 1));
+    }
+    move(storage, closure);
+
+    job->data = storage;
+    job->capture_destroy = destroy;
+    if(handle) {
+        job_hold(job, handle);
+    }
+    return job_submit(job, counter, nullptr, affinity);
+}
+
+// Queues a job that runs to completion on the scheduler's own stack,
+// with no fiber and no context switch. Meant for leaf work: the job may
+// create other jobs but must not yield or wait.
+job_t* job_create_inline(zero_entrypoint_t job_entrypoint, zero_userdata_t data, ZERO_ATOMIC(int) *counter, job_affinity_t affinity) {
+    return job_submit(job_alloc_inline(job_entrypoint, data), counter, nullptr, affinity);
 }
 
-// void job_create(zero_entrypoint_t job_entrypoint, std::atomic<int> *counter) {
-void job_create(zero_entrypoint_t job_entrypoint, ZERO_ATOMIC(int) *counter) {
-    job_t job = {0};
-    job.fiber = zero_fiber_make("", 4*1024, job_entrypoint, NULL);
-    
-    if(counter) {
-        job.status_counter = counter;
-        ZERO_ATOMIC_INCREMENT(job.status_counter);
-    } else {
-        job.status_counter = nullptr;
+// Queues a job on a shared-stack fiber (see zero_fiber_make_shared).
+// While it is suspended the job only holds as much memory as its stack
+// is actually deep, at the cost of a copy whenever another shared job
+// takes over the worker's stack. Suited to large numbers of mostly
+// idle jobs; the job stays on the worker that first runs it.
+job_t* job_create_shared(zero_entrypoint_t job_entrypoint, zero_userdata_t data, ZERO_ATOMIC(int) *counter, job_affinity_t affinity) {
+    return job_submit(job_alloc_shared(job_entrypoint, data), counter, nullptr, affinity);
+}
+
+static bool job_periodic_later(const job_periodic_t *a, const job_periodic_t *b) {
+    return a->next_time > b->next_time;
+}
+
+// Takes cancelled periodic jobs out of the heap, so their next tick no
+// longer counts as a deadline. Records are freed once the last tick's
+// job is done. The heap is only scanned after a job_periodic_cancel.
+static void job_periodic_sweep() {
+    for(size_t i = 0; i < job_periodic_retired.size(); ) {
+        job_periodic_t *periodic = job_periodic_retired[i];
+        if(ZERO_ATOMIC_LOAD(&periodic->in_flight)) {
+            i++;
+            continue;
+        }
+        ZERO_JOBS_FREE(periodic);
+        job_periodic_retired[i] = job_periodic_retired.back();
+        job_periodic_retired.pop_back();
+    }
+
+    int cancels = ZERO_ATOMIC_LOAD(&zero_jobs_periodic_cancels);
+    if(cancels == job_periodic_cancels_seen) {
+        return;
+    }
+    job_periodic_cancels_seen = cancels;
+
+    auto kept = job_periodic_heap.begin();
+    for(job_periodic_t *periodic : job_periodic_heap) {
+        if(!ZERO_ATOMIC_LOAD(&periodic->cancelled)) {
+            *kept++ = periodic;
+        }
+        else if(ZERO_ATOMIC_LOAD(&periodic->in_flight)) {
+            job_periodic_retired.push_back(periodic);
+        }
+        else {
+            ZERO_JOBS_FREE(periodic);
+        }
     }
-    
-    jobs.push(job);
+    job_periodic_heap.erase(kept, job_periodic_heap.end());
+    std::make_heap(job_periodic_heap.begin(), job_periodic_heap.end(), job_periodic_later);
 }
-void job_yield() {
-    yielded_jobs.push(*job_current);
-    zero_fiber_yield(nullptr);
+
+// Queues a tick for every periodic job that is due at [time]
+static void job_periodic_fire(double time) {
+    job_periodic_sweep();
+    while(!job_periodic_heap.empty() && job_periodic_heap.front()->next_time <= time + ZERO_JOBS_TIMING_ERROR) {
+        std::pop_heap(job_periodic_heap.begin(), job_periodic_heap.end(), job_periodic_later);
+        job_periodic_t *periodic = job_periodic_heap.back();
+        job_periodic_heap.pop_back();
+
+        // the last tick's job still holds [in_flight], keep the record
+        // until it is done
+        if(ZERO_ATOMIC_LOAD(&periodic->cancelled) && !ZERO_ATOMIC_LOAD(&periodic->in_flight)) {
+            ZERO_JOBS_FREE(periodic);
+            continue;
+        }
+
+        // step over every tick up to [time] at once
+        double due = floor((time + ZERO_JOBS_TIMING_ERROR - periodic->next_time) / periodic->period) + 1.0;
+        periodic->missed += (uint64_t)due - 1;
+        periodic->next_time += due * periodic->period;
+
+        if(ZERO_ATOMIC_LOAD(&periodic->cancelled)) {
+            // waiting on the last tick's job
+        }
+        else if(ZERO_ATOMIC_LOAD(&periodic->in_flight)) {
+            periodic->missed++;
+        }
+        else {
+            job_t *job = (periodic->flags & JOB_PERIODIC_INLINE)
+                ? job_alloc_inline(periodic->entrypoint, periodic->data)
+                : job_alloc(periodic->entrypoint, periodic->data);
+
+            if(job_submit(job, &periodic->in_flight, nullptr, periodic->affinity)) {
+                periodic->ticks++;
+            }
+            else {
+                periodic->missed++;
+            }
+        }
+
+        job_periodic_heap.push_back(periodic);
+        std::push_heap(job_periodic_heap.begin(), job_periodic_heap.end(), job_periodic_later);
+    }
 }
 
-void job_wait(double time) {
-    job_waiting_t wait = { 0 };
-    wait.job = *job_current;
-    wait.condition = job_waiting_t::JOB_WAIT_TIMER;
-    wait.end_time = latest_time + time;
-    waiting_jobs.push(wait);
-    zero_fiber_yield(nullptr);
+// Runs [job_entrypoint] with [data] every [period] seconds of jobs_run
+// time, starting one period from now, as a fresh job each tick. The
+// calling thread owns the timer and fires it from its jobs_run. Returns
+// NULL if [period] isn't positive or allocation fails.
+job_periodic_t* job_periodic_create(zero_entrypoint_t job_entrypoint, zero_userdata_t data, double period, int flags, job_affinity_t affinity) {
+    if(!(period > 0.0)) {
+        return NULL;
+    }
+
+    job_periodic_t *periodic = (job_periodic_t*) ZERO_JOBS_MALLOC(sizeof(job_periodic_t));
+    if(!periodic) {
+        return NULL;
+    }
+
+    periodic->entrypoint = job_entrypoint;
+    periodic->data = data;
+    periodic->period = period;
+    periodic->next_time = latest_time + period;
+    periodic->flags = flags;
+    periodic->affinity = affinity;
+    periodic->in_flight = 0;
+    periodic->cancelled = 0;
+    periodic->ticks = 0;
+    periodic->missed = 0;
+
+    job_periodic_heap.push_back(periodic);
+    std::push_heap(job_periodic_heap.begin(), job_periodic_heap.end(), job_periodic_later);
+    return periodic;
+}
+
+// Stops further ticks, a tick already queued still runs. The owning
+// thread frees the record, don't touch [periodic] after this.
+void job_periodic_cancel(job_periodic_t *periodic) {
+    if(periodic) {
+        ZERO_ATOMIC_SWAP(&periodic->cancelled, 1);
+        ZERO_ATOMIC_INCREMENT(&zero_jobs_periodic_cancels);
+    }
+}
+
+// Requests cancellation. A job that hasn't started yet is never
+// resumed, its slot is reclaimed on the next jobs_run pass. A job
+// that is parked in a wait is resumed with JOB_WAIT_CANCELLED, and
+// a running job can poll job_is_cancelled to unwind early.
+void job_cancel(job_t *job) {
+    if(job) {
+        ZERO_ATOMIC_SWAP(&job->cancelled, 1);
+    }
+}
+
+void job_cancel(job_handle_t handle) {
+    if(job_handle_valid(handle)) {
+        job_cancel(handle.job);
+    }
+}
+
+int job_is_cancelled() {
+    return job_cancel_requested(job_current);
 }
 
-void job_wait_on_condition(ZERO_ATOMIC(int) *counter) {
-    job_waiting_t wait = { 0 };
-    wait.job = *job_current;
-    wait.condition = job_waiting_t::JOB_WAIT_COUNTER_ZERO;
-    wait.data_address = (void*)counter;
-    waiting_jobs.push(wait);
+// Names [job] for jobs_perf_stats and its fiber for zero_profiler.h,
+// jobs sharing a [description] are counted together whatever their
+// entrypoint. [description] must outlive the stats, a string literal
+// is the usual choice.
+void job_describe(job_t *job, const char *description) {
+    if(job) {
+        job->description = description;
+        if(job->fiber) {
+            job->fiber->description = description ? description : "";
+        }
+    }
+}
+
+static int job_park(int condition, void *address, double end_time, bool cancellable = true) {
+    ZERO_JOBS_ASSERT(job_current && job_current->fiber);
+
+    job_waiting_t *wait = &job_current->wait;
+    wait->condition = (decltype(wait->condition))condition;
+    wait->data_address = address;
+    wait->end_time = end_time;
+    wait->cancellable = cancellable;
+    waiting_jobs.push(job_current);
+    return (int)(intptr_t)zero_fiber_yield(nullptr);
+}
+
+int job_yield() {
+    ZERO_JOBS_ASSERT(job_current && job_current->fiber);
+
+    yielded_jobs.push(job_current);
     zero_fiber_yield(nullptr);
+    return job_is_cancelled() ? JOB_WAIT_CANCELLED : JOB_WAIT_OK;
+}
+
+int job_wait(double time) {
+    return job_park(job_waiting_t::JOB_WAIT_TIMER, NULL, latest_time + time);
+}
+
+int job_wait_on_condition(ZERO_ATOMIC(int) *counter) {
+    return job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)counter, JOB_WAIT_FOREVER);
+}
+
+// returns JOB_WAIT_TIMED_OUT if [counter] is still non-zero after [timeout]
+int job_wait_on_condition_timeout(ZERO_ATOMIC(int) *counter, double timeout) {
+    return job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)counter, latest_time + timeout);
+}
+
+// waits until the int at [address] reads zero
+int job_wait_zero(void *address) {
+    return job_park(job_waiting_t::JOB_WAIT_DATA_ZERO, address, JOB_WAIT_FOREVER);
+}
+
+int job_wait_zero_timeout(void *address, double timeout) {
+    return job_park(job_waiting_t::JOB_WAIT_DATA_ZERO, address, latest_time + timeout);
+}
+
+static void job_blocking_thread() {
+    job_blocking_pool_t *pool = &zero_jobs_blocking;
+    std::unique_lock<std::mutex> lock(pool->lock);
+
+    for(;;) {
+        pool->idle++;
+        pool->signal.wait(lock, [pool] { return pool->stopping || !pool->calls.empty(); });
+        pool->idle--;
+        if(pool->calls.empty()) {
+            return;
+        }
+
+        job_blocking_call_t *call = pool->calls.front();
+        pool->calls.pop();
+        lock.unlock();
+
+        call->result = call->entrypoint(call->data);
+        // the call is gone once pending drops, the job may already
+        // have been resumed
+        int worker = call->worker;
+        ZERO_ATOMIC_DECREMENT(&call->pending);
+        if(worker >= 0) {
+            jobs_wake(worker);
+        }
+
+        lock.lock();
+    }
+}
+
+// Parks the calling job while [entrypoint] runs on a separate pool of
+// up to ZERO_JOBS_BLOCKING_THREADS threads, so a call with no
+// non-blocking form (file I/O, fsync, third party libraries) doesn't
+// hold up the worker's other jobs. Returns what [entrypoint] returned.
+// The wait can't be cancelled since the call can't be interrupted.
+// Outside of a fiber job [entrypoint] is simply called.
+zero_userdata_t job_run_blocking(zero_entrypoint_t entrypoint, zero_userdata_t data) {
+    if(!job_current || !job_current->fiber) {
+        return entrypoint(data);
+    }
+
+    job_blocking_call_t call;
+    call.entrypoint = entrypoint;
+    call.data = data;
+    call.result = nullptr;
+    call.pending = 1;
+    call.worker = job_worker_index;
+
+    job_blocking_pool_t *pool = &zero_jobs_blocking;
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->calls.push(&call);
+        if((int)pool->calls.size() > pool->idle && pool->threads.size() < ZERO_JOBS_BLOCKING_THREADS) {
+            pool->threads.emplace_back(job_blocking_thread);
+        }
+    }
+    pool->signal.notify_one();
+
+    job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)&call.pending, JOB_WAIT_FOREVER, false);
+    return call.result;
+}
+
+// Joins the blocking threads once the calls queued so far are done,
+// a later job_run_blocking starts them again.
+void jobs_blocking_stop() {
+    job_blocking_pool_t *pool = &zero_jobs_blocking;
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->stopping = true;
+        threads.swap(pool->threads);
+    }
+    pool->signal.notify_all();
+
+    for(auto &thread : threads) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(pool->lock);
+    pool->stopping = false;
+}
+
+// Parks the job until [fd] is ready for [events] (JOB_IO_READ and/or
+// JOB_IO_WRITE) on the calling worker's epoll set, which jobs_run
+// checks every pass and jobs_run_until_idle sleeps in. Errors and
+// hangups count as ready. One job at a time can wait to read [fd] and
+// one to write it, on the same worker. Returns -1 if the fd can't be
+// watched or another job already waits on it for the same direction,
+// and always outside of Linux.
+int job_wait_fd(int fd, int events, double timeout) {
+    ZERO_JOBS_ASSERT(job_current && job_current->fiber);
+#if ZERO_ATOMIC_LINUX
+    if(!(events & (JOB_IO_READ | JOB_IO_WRITE)) || job_io_open() != 0) {
+        return -1;
+    }
+
+    job_t *job = job_current;
+    job_io_fd_t *record = &job_io_fds[fd];
+    record->fd = fd;
+    if(((events & JOB_IO_READ) && record->reader) || ((events & JOB_IO_WRITE) && record->writer)) {
+        return -1;
+    }
+
+    if(events & JOB_IO_READ) record->reader = job;
+    if(events & JOB_IO_WRITE) record->writer = job;
+    if(job_io_arm(record) != 0) {
+        job_io_forget(fd, job);
+        return -1;
+    }
+
+    job->io_pending = 1;
+    job_io_waiters++;
+    int result = job_park(job_waiting_t::JOB_WAIT_FD, (void*)&job->io_pending,
+                          timeout == JOB_WAIT_FOREVER ? JOB_WAIT_FOREVER : latest_time + timeout);
+    job_io_waiters--;
+
+    // timed out or cancelled with the fd still armed, or woken for
+    // one of two directions
+    job_io_forget(fd, job);
+    job->io_pending = 0;
+    return result;
+#else
+    (void)fd;
+    (void)events;
+    (void)timeout;
+    return -1;
+#endif
+}
+
+int job_fd_nonblocking(int fd) {
+#if ZERO_ATOMIC_LINUX
+    int flags = fcntl(fd, F_GETFL, 0);
+    if(flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+#else
+    (void)fd;
+    return -1;
+#endif
+}
+
+// Reads what is available from a non-blocking [fd], parking the job
+// in job_wait_fd while nothing is. Returns the bytes read, 0 at end of
+// file or -1 with errno set, ECANCELED if the job was cancelled while
+// waiting.
+intptr_t job_read(int fd, void *buffer, size_t size) {
+#if ZERO_ATOMIC_LINUX
+    for(;;) {
+        ssize_t count = read(fd, buffer, size);
+        if(count >= 0) return count;
+        if(errno == EINTR) continue;
+        if(errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+
+        int result = job_wait_fd(fd, JOB_IO_READ);
+        if(result == JOB_WAIT_CANCELLED) {
+            errno = ECANCELED;
+            return -1;
+        }
+        if(result != JOB_WAIT_OK) return -1;
+    }
+#else
+    (void)fd;
+    (void)buffer;
+    (void)size;
+    return -1;
+#endif
+}
+
+// Writes all of [buffer] to a non-blocking [fd], parking the job in
+// job_wait_fd whenever the fd is full. Returns [size], or -1 with
+// errno set, ECANCELED if the job was cancelled while waiting.
+intptr_t job_write(int fd, const void *buffer, size_t size) {
+#if ZERO_ATOMIC_LINUX
+    size_t written = 0;
+    while(written < size) {
+        ssize_t count = write(fd, (const char*)buffer + written, size - written);
+        if(count >= 0) {
+            written += (size_t)count;
+            continue;
+        }
+        if(errno == EINTR) continue;
+        if(errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+
+        int result = job_wait_fd(fd, JOB_IO_WRITE);
+        if(result == JOB_WAIT_CANCELLED) {
+            errno = ECANCELED;
+            return -1;
+        }
+        if(result != JOB_WAIT_OK) return -1;
+    }
+    return (intptr_t)written;
+#else
+    (void)fd;
+    (void)buffer;
+    (void)size;
+    return -1;
+#endif
+}
+
+// The group is owned by the calling job, or by nobody when called
+// from outside a job.
+void job_group_init(job_group_t *group) {
+    group->pending = 0;
+    group->cancelled = 0;
+    group->owner = job_current;
+}
+
+job_t* job_group_create(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    return job_submit(job_alloc(job_entrypoint, data), &group->pending, group, affinity);
+}
+
+job_t* job_group_create_inline(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    return job_submit(job_alloc_inline(job_entrypoint, data), &group->pending, group, affinity);
+}
+
+job_t* job_group_create_shared(job_group_t *group, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    return job_submit(job_alloc_shared(job_entrypoint, data), &group->pending, group, affinity);
+}
+
+void job_group_cancel(job_group_t *group) {
+    ZERO_ATOMIC_SWAP(&group->cancelled, 1);
+}
+
+// Waits for every job in the group. The children may still reference
+// the group, so the wait itself can't be cut short; if the caller is
+// cancelled meanwhile the cancellation is passed down to the group
+// and JOB_WAIT_CANCELLED is returned once the children have unwound.
+// Outside of a job this runs the scheduler until the group drains,
+// with the clock moving on in real time, see job_pump.
+int job_group_wait(job_group_t *group) {
+    if(!job_current) {
+        job_pump_t pump = job_pump_begin();
+        while(ZERO_ATOMIC_LOAD(&group->pending) != 0) {
+            job_pump(&pump, &group->pending);
+        }
+        return ZERO_ATOMIC_LOAD(&group->cancelled) ? JOB_WAIT_CANCELLED : JOB_WAIT_OK;
+    }
+
+    if(job_is_cancelled()) {
+        job_group_cancel(group);
+    }
+    job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)&group->pending, JOB_WAIT_FOREVER, false);
+
+    return job_is_cancelled() || ZERO_ATOMIC_LOAD(&group->cancelled) ? JOB_WAIT_CANCELLED : JOB_WAIT_OK;
+}
+
+// Queues a fiber job that keeps its slot once it finishes, so
+// job_await can hand back what its entrypoint returned. The handle
+// must be passed to job_await or job_release exactly once. Returns a
+// handle with a NULL job if the pool is exhausted.
+job_handle_t job_create_handle(zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    job_handle_t handle = { NULL, 0 };
+    job_t *job = job_alloc(job_entrypoint, data);
+    if(job) {
+        job_hold(job, &handle);
+        job_submit(job, nullptr, nullptr, affinity);
+    }
+    return handle;
+}
+
+// Waits for the job to finish, parking the calling job or running the
+// scheduler when called from outside of one, then stores its result in
+// [result] and frees the job. Returns JOB_WAIT_CANCELLED if the job was
+// cancelled, its result is whatever it returned while unwinding, or -1
+// for a stale or empty handle. The wait itself can't be cancelled.
+int job_await(job_handle_t handle, zero_userdata_t *result) {
+    if(!job_handle_valid(handle)) {
+        return -1;
+    }
+
+    job_t *job = handle.job;
+    if(!job_current) {
+        job_pump_t pump = job_pump_begin();
+        while(ZERO_ATOMIC_LOAD(&job->handle_state) != JOB_HANDLE_DONE) {
+            job_pump(&pump, &job->handle_state);
+        }
+    }
+    else if(ZERO_ATOMIC_LOAD(&job->handle_state) != JOB_HANDLE_DONE) {
+        job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)&job->handle_state, JOB_WAIT_FOREVER, false);
+    }
+
+    int status = job_cancel_requested(job) ? JOB_WAIT_CANCELLED : JOB_WAIT_OK;
+    if(result) {
+        *result = job->result;
+    }
+    job_free(job);
+    return status;
+}
+
+// Gives up the result, the job is freed as soon as it finishes.
+void job_release(job_handle_t handle) {
+    if(!job_handle_valid(handle)) {
+        return;
+    }
+
+    job_t *job = handle.job;
+    if(ZERO_ATOMIC_CAS(&job->handle_state, JOB_HANDLE_HELD, JOB_HANDLE_RELEASED) != JOB_HANDLE_HELD) {
+        job_free(job);
+    }
+}
+
+static job_frame_t *job_frame_slot(job_pipeline_t *pipeline, uint64_t index) {
+    return &pipeline->frames[index % (uint64_t)pipeline->max_in_flight];
+}
+
+static void job_frame_retire(job_frame_t *frame) {
+    for(int worker = 0; worker < ZERO_JOBS_MAX_WORKERS; worker++) {
+        job_arena_rewind(&frame->arenas[worker]);
+    }
+}
+
+// the first of [frame]'s counters that isn't zero yet, NULL once the
+// frame can be retired
+static ZERO_ATOMIC(int) *job_frame_pending(job_frame_t *frame) {
+    if(ZERO_ATOMIC_LOAD(&frame->waiters) != 0) return &frame->waiters;
+    for(int stage = 0; stage < ZERO_JOBS_PIPELINE_STAGES; stage++) {
+        if(ZERO_ATOMIC_LOAD(&frame->stages[stage].pending) != 0) return &frame->stages[stage].pending;
+    }
+    return NULL;
+}
+
+// runs the scheduler here until [frame] can be retired
+static void job_frame_drain(job_frame_t *frame) {
+    job_pump_t pump = job_pump_begin();
+    while(ZERO_ATOMIC(int) *pending = job_frame_pending(frame)) {
+        job_pump(&pump, pending);
+    }
+}
+
+// retires finished frames from the oldest on, stopping at the first
+// one still running
+static void job_pipeline_retire(job_pipeline_t *pipeline) {
+    while(pipeline->oldest_index < pipeline->next_index) {
+        job_frame_t *frame = job_frame_slot(pipeline, pipeline->oldest_index);
+        if(!job_frame_done(frame)) break;
+
+        job_frame_retire(frame);
+        pipeline->oldest_index++;
+    }
+}
+
+// [max_in_flight] is clamped to ZERO_JOBS_PIPELINE_FRAMES, 1 makes every
+// frame wait for the one before it to finish
+int job_pipeline_init(job_pipeline_t *pipeline, int max_in_flight) {
+    if(max_in_flight < 1) {
+        return -1;
+    }
+
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->max_in_flight = max_in_flight < ZERO_JOBS_PIPELINE_FRAMES ? max_in_flight : ZERO_JOBS_PIPELINE_FRAMES;
+    for(int i = 0; i < ZERO_JOBS_PIPELINE_FRAMES; i++) {
+        pipeline->frames[i].pipeline = pipeline;
+    }
+    return 0;
+}
+
+// waits for and retires every frame in flight
+void job_pipeline_flush(job_pipeline_t *pipeline) {
+    while(pipeline->oldest_index < pipeline->next_index) {
+        job_frame_drain(job_frame_slot(pipeline, pipeline->oldest_index));
+        job_pipeline_retire(pipeline);
+    }
+}
+
+void job_pipeline_destroy(job_pipeline_t *pipeline) {
+    job_pipeline_flush(pipeline);
+
+    for(int i = 0; i < ZERO_JOBS_PIPELINE_FRAMES; i++) {
+        for(int worker = 0; worker < ZERO_JOBS_MAX_WORKERS; worker++) {
+            job_arena_release(&pipeline->frames[i].arenas[worker]);
+        }
+    }
+}
+
+// Starts the next frame. With the ring full this first runs the
+// scheduler until the oldest frame is done and retires it.
+job_frame_t* job_frame_begin(job_pipeline_t *pipeline) {
+    ZERO_JOBS_ASSERT(!job_current);
+
+    job_pipeline_retire(pipeline);
+    while(pipeline->next_index - pipeline->oldest_index >= (uint64_t)pipeline->max_in_flight) {
+        job_frame_drain(job_frame_slot(pipeline, pipeline->oldest_index));
+        job_pipeline_retire(pipeline);
+    }
+
+    job_frame_t *frame = job_frame_slot(pipeline, pipeline->next_index);
+    frame->index = pipeline->next_index++;
+    frame->waiters = 0;
+    for(int stage = 0; stage < ZERO_JOBS_PIPELINE_STAGES; stage++) {
+        job_group_init(&frame->stages[stage]);
+    }
+    return frame;
+}
+
+// The frame begun before [frame], or NULL once it has been retired, in
+// which case anything waiting on it is already satisfied.
+job_frame_t* job_frame_previous(job_frame_t *frame) {
+    job_pipeline_t *pipeline = frame->pipeline;
+    if(frame->index == 0 || frame->index - 1 < pipeline->oldest_index) {
+        return NULL;
+    }
+    return job_frame_slot(pipeline, frame->index - 1);
+}
+
+job_t* job_frame_create(job_frame_t *frame, int stage, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    ZERO_JOBS_ASSERT(stage >= 0 && stage < ZERO_JOBS_PIPELINE_STAGES);
+    return job_group_create(&frame->stages[stage], job_entrypoint, data, affinity);
+}
+
+job_t* job_frame_create_inline(job_frame_t *frame, int stage, zero_entrypoint_t job_entrypoint, zero_userdata_t data, job_affinity_t affinity) {
+    ZERO_JOBS_ASSERT(stage >= 0 && stage < ZERO_JOBS_PIPELINE_STAGES);
+    return job_group_create_inline(&frame->stages[stage], job_entrypoint, data, affinity);
 }
 
-void job_wait_zero() {
+// Waits until every job in [stage] of [frame] has finished, the way a
+// stage declares a dependency on a stage of an earlier frame. A NULL
+// [frame] is already retired and returns at once. Unlike
+// job_group_wait, cancelling the caller doesn't cancel the stage it
+// waits on, the wait just returns JOB_WAIT_CANCELLED.
+int job_frame_wait_stage(job_frame_t *frame, int stage) {
+    if(!frame) {
+        return JOB_WAIT_OK;
+    }
+
+    ZERO_JOBS_ASSERT(stage >= 0 && stage < ZERO_JOBS_PIPELINE_STAGES);
+    ZERO_ATOMIC(int) *pending = &frame->stages[stage].pending;
+
+    if(!job_current) {
+        job_pump_t pump = job_pump_begin();
+        while(ZERO_ATOMIC_LOAD(pending) != 0) {
+            job_pump(&pump, pending);
+        }
+        return JOB_WAIT_OK;
+    }
+
+    if(ZERO_ATOMIC_LOAD(pending) == 0) {
+        return JOB_WAIT_OK;
+    }
+
+    ZERO_ATOMIC_INCREMENT(&frame->waiters);
+    int result = job_park(job_waiting_t::JOB_WAIT_COUNTER_ZERO, (void*)pending, JOB_WAIT_FOREVER);
+    ZERO_ATOMIC_DECREMENT(&frame->waiters);
+    return result;
+}
+
+int job_frame_done(job_frame_t *frame) {
+    return job_frame_pending(frame) == NULL;
+}
+
+// Allocates memory that lives until [frame] is retired, from an arena
+// of the calling worker's own, so it is only safe from a thread that
+// entered as a worker.
+void *job_frame_alloc(job_frame_t *frame, size_t size, size_t align) {
+    ZERO_JOBS_ASSERT(job_worker_index >= 0);
+    return job_arena_alloc_from(&frame->arenas[job_worker_index], size, align);
+}
+
+void job_graph_init(job_graph_t *graph) {
+    graph->nodes.clear();
+    graph->edges.clear();
+    graph->successors.clear();
+    graph->roots.clear();
+    job_group_init(&graph->group);
+    graph->built = false;
+}
+
+// Adds a node and returns its index, for job_graph_depend. Invalidates
+// a previous job_graph_build.
+int job_graph_add(job_graph_t *graph, zero_entrypoint_t job_entrypoint, zero_userdata_t data, int flags, job_affinity_t affinity) {
+    job_graph_node_t node = { 0 };
+    node.entrypoint = job_entrypoint;
+    node.data = data;
+    node.flags = flags;
+    node.affinity = affinity;
+
+    graph->nodes.push_back(node);
+    graph->built = false;
+    return (int)graph->nodes.size() - 1;
+}
+
+// [node] won't start until [predecessor] has finished
+int job_graph_depend(job_graph_t *graph, int node, int predecessor) {
+    int count = (int)graph->nodes.size();
+    if(node < 0 || node >= count || predecessor < 0 || predecessor >= count || node == predecessor) {
+        return -1;
+    }
+
+    graph->edges.push_back(std::make_pair(predecessor, node));
+    graph->built = false;
+    return 0;
+}
+
+// Lays out the successor lists and finds the roots. Returns -1 if the
+// dependencies form a cycle.
+int job_graph_build(job_graph_t *graph) {
+    size_t count = graph->nodes.size();
+
+    for(size_t i = 0; i < count; i++) {
+        graph->nodes[i].graph = graph;
+        graph->nodes[i].predecessor_count = 0;
+        graph->nodes[i].successor_count = 0;
+    }
+    for(auto &edge : graph->edges) {
+        graph->nodes[edge.first].successor_count++;
+        graph->nodes[edge.second].predecessor_count++;
+    }
+
+    int first = 0;
+    for(size_t i = 0; i < count; i++) {
+        graph->nodes[i].successor_first = first;
+        first += graph->nodes[i].successor_count;
+        graph->nodes[i].successor_count = 0;
+    }
+    graph->successors.assign(graph->edges.size(), 0);
+    for(auto &edge : graph->edges) {
+        job_graph_node_t *node = &graph->nodes[edge.first];
+        graph->successors[node->successor_first + node->successor_count++] = edge.second;
+    }
+
+    graph->roots.clear();
+    for(size_t i = 0; i < count; i++) {
+        if(!graph->nodes[i].predecessor_count) graph->roots.push_back((int)i);
+    }
 
+    // every node is reachable from the roots by Kahn's algorithm unless
+    // some of them wait on each other
+    std::vector<int> remaining(count);
+    std::vector<int> ready(graph->roots);
+    size_t reached = 0;
+    for(size_t i = 0; i < count; i++) {
+        remaining[i] = graph->nodes[i].predecessor_count;
+    }
+    while(!ready.empty()) {
+        job_graph_node_t *node = &graph->nodes[ready.back()];
+        ready.pop_back();
+        reached++;
+
+        for(int i = 0; i < node->successor_count; i++) {
+            int successor = graph->successors[node->successor_first + i];
+            if(--remaining[successor] == 0) ready.push_back(successor);
+        }
+    }
+
+    graph->built = reached == count;
+    return graph->built ? 0 : -1;
+}
+
+static job_t *job_graph_spawn(job_graph_node_t *node);
+
+// drops [counter] by one, true for the caller that takes it to zero
+static bool job_counter_release(ZERO_ATOMIC(int) *counter) {
+    int value;
+    do {
+        value = ZERO_ATOMIC_LOAD(counter);
+    } while(ZERO_ATOMIC_CAS(counter, value, value - 1) != value);
+    return value == 1;
+}
+
+// every node runs through here, the node that finishes last among a
+// successor's predecessors is the one that spawns it
+static void *job_graph_trampoline(void *data) {
+    job_graph_node_t *node = (job_graph_node_t*)data;
+    job_graph_t *graph = node->graph;
+
+    node->entrypoint(node->data);
+
+    for(int i = 0; i < node->successor_count; i++) {
+        job_graph_node_t *successor = &graph->nodes[graph->successors[node->successor_first + i]];
+        if(job_counter_release(&successor->remaining) && !job_graph_spawn(successor)) {
+            // the pool is exhausted, run it here instead
+            job_graph_trampoline(successor);
+        }
+    }
+    return nullptr;
+}
+
+static job_t *job_graph_spawn(job_graph_node_t *node) {
+    job_graph_t *graph = node->graph;
+    if(node->flags & JOB_GRAPH_INLINE) {
+        return job_group_create_inline(&graph->group, job_graph_trampoline, node, node->affinity);
+    }
+    return job_group_create(&graph->group, job_graph_trampoline, node, node->affinity);
+}
+
+// Starts a run of the graph, building it first if needed. Only one run
+// can be in flight at a time. Returns -1 if the graph has a cycle or
+// the previous run hasn't finished.
+int job_graph_submit(job_graph_t *graph) {
+    if(!graph->built && job_graph_build(graph) != 0) {
+        return -1;
+    }
+    if(ZERO_ATOMIC_LOAD(&graph->group.pending) != 0) {
+        return -1;
+    }
+
+    job_group_init(&graph->group);
+    for(auto &node : graph->nodes) {
+        node.remaining = node.predecessor_count;
+    }
+
+    for(int root : graph->roots) {
+        job_graph_node_t *node = &graph->nodes[root];
+        if(!job_graph_spawn(node)) {
+            job_graph_trampoline(node);
+        }
+    }
+    return 0;
+}
+
+// waits for the run in flight, see job_group_wait
+int job_graph_wait(job_graph_t *graph) {
+    return job_group_wait(&graph->group);
+}
+
+// nodes that haven't started are skipped along with everything after them
+void job_graph_cancel(job_graph_t *graph) {
+    job_group_cancel(&graph->group);
 }
+
+#endif // ZERO_JOBS_IMPL
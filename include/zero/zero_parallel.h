@@ -0,0 +1,350 @@
+#ifndef ZERO_PARALLEL_INCLUDED
+/*
+    zero_parallel.h    -- parallel algorithms on top of zero_jobs.h
+
+    Project URL: https://github.com/zerotri/zero
+
+    Example:
+
+        std::vector<float> values = ...;
+        parallel_transform(values.begin(), values.end(), values.begin(),
+                           [](float v) { return v * 2.0f; });
+        parallel_sort(values.begin(), values.end());
+
+    Every algorithm splits its range into chunks of at least [grain]
+    elements and runs chunks below that size sequentially. Leaves that
+    never wait run as inline jobs, only recursive splits that have to
+    join take a pooled fiber. If the job pool is exhausted a chunk is
+    simply run on the calling job. The algorithms can be called from a
+    job or from outside of one, in which case the calling thread runs
+    the scheduler until the work is done.
+
+    Chunks are handed round-robin to the jobs_worker_count workers,
+    starting with the calling thread's own, as JOB_AFFINITY_WORKER(k) |
+    JOB_AFFINITY_PREFER. A chunk meant for a worker that hasn't entered
+    the scheduler stays on the calling thread, so with a single worker
+    everything runs there.
+
+    size_t parallel_grain_size(size_t count, size_t min_grain);
+        Pick a chunk size giving every worker a few chunks, but never
+        less than [min_grain].
+
+    void parallel_invoke(F&&... functions);
+        Run all of [functions], returning once all have finished.
+
+    void parallel_transform(InputIt first, InputIt last, OutputIt out, UnaryOp op, size_t grain = 0);
+    void parallel_sort(RandomIt first, RandomIt last, Compare comp = Compare(), size_t grain = 0);
+    void parallel_scan(InputIt first, InputIt last, OutputIt out, BinaryOp op = BinaryOp(), size_t grain = 0);
+        Inclusive prefix scan, [op] must be associative.
+
+    Each chunk writes through its own copy of [out] advanced to the
+    chunk's start, and parallel_scan reads chunk totals back from it,
+    so [out] must be a forward iterator over existing elements. An
+    output-only iterator such as std::back_inserter is rejected at
+    compile time, size the destination first.
+
+    Pass 0 as [grain] to use parallel_grain_size with
+    ZERO_PARALLEL_MIN_GRAIN.
+*/
+
+#define ZERO_PARALLEL_INCLUDED (1)
+
+#include <stddef.h>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <utility>
+
+#include "zero_jobs.h"
+
+#ifndef ZERO_PARALLEL_MIN_GRAIN
+#define ZERO_PARALLEL_MIN_GRAIN (2048)
+#endif
+
+// chunks a call is split into, more chunks interleave better with
+// other jobs but cost more job overhead
+#ifndef ZERO_PARALLEL_CHUNKS_PER_WORKER
+#define ZERO_PARALLEL_CHUNKS_PER_WORKER (4)
+#endif
+
+// upper bound on chunks per call, the chunk records live on the
+// caller's stack
+#ifndef ZERO_PARALLEL_MAX_CHUNKS
+#define ZERO_PARALLEL_MAX_CHUNKS (256)
+#endif
+
+inline size_t parallel_grain_size(size_t count, size_t min_grain) {
+    size_t chunks = (size_t)ZERO_PARALLEL_CHUNKS_PER_WORKER * (size_t)jobs_worker_count();
+    size_t grain = (count + chunks - 1) / chunks;
+    size_t smallest = (count + ZERO_PARALLEL_MAX_CHUNKS - 1) / ZERO_PARALLEL_MAX_CHUNKS;
+
+    if(grain < min_grain) grain = min_grain;
+    if(grain < smallest) grain = smallest;
+    return grain ? grain : 1;
+}
+
+template<typename F>
+static void *parallel_thunk(void *data) {
+    (*(F*)data)();
+    return nullptr;
+}
+
+// the worker [offset] places after the calling thread's, round-robin
+// over the workers, offset 0 keeps the job on the calling thread
+inline job_affinity_t parallel_affinity(size_t offset) {
+    size_t workers = (size_t)jobs_worker_count();
+    if(offset % workers == 0) {
+        return JOB_AFFINITY_ANY;
+    }
+
+    size_t self = job_worker_index >= 0 ? (size_t)job_worker_index : 0;
+    return JOB_AFFINITY_WORKER((self + offset) % workers) | JOB_AFFINITY_PREFER;
+}
+
+// forks [f] into [group] as a job that may wait, or runs it here
+template<typename F>
+static void parallel_fork(job_group_t *group, F *f, job_affinity_t affinity) {
+    if(!job_group_create(group, parallel_thunk<F>, (zero_userdata_t)f, affinity)) {
+        (*f)();
+    }
+}
+
+// forks [f] into [group] as a leaf that never waits, or runs it here
+template<typename F>
+static void parallel_fork_leaf(job_group_t *group, F *f, job_affinity_t affinity) {
+    if(!job_group_create_inline(group, parallel_thunk<F>, (zero_userdata_t)f, affinity)) {
+        (*f)();
+    }
+}
+
+template<typename F>
+static void parallel_invoke_fork(job_group_t *group, size_t offset, F &&f) {
+    parallel_fork(group, &f, parallel_affinity(offset));
+}
+
+template<typename F, typename... Rest>
+static void parallel_invoke_fork(job_group_t *group, size_t offset, F &&f, Rest&&... rest) {
+    parallel_fork(group, &f, parallel_affinity(offset));
+    parallel_invoke_fork(group, offset + 1, std::forward<Rest>(rest)...);
+}
+
+inline void parallel_invoke() {
+}
+
+// the first function runs on the calling thread, the others are
+// spread over the other workers
+template<typename F, typename... Rest>
+void parallel_invoke(F &&f, Rest&&... rest) {
+    job_group_t group;
+    job_group_init(&group);
+
+    if constexpr (sizeof...(rest) > 0) {
+        parallel_invoke_fork(&group, 1, std::forward<Rest>(rest)...);
+    }
+    f();
+
+    job_group_wait(&group);
+}
+
+// [out] has to be advanced to each chunk's start, see above
+template<typename OutputIt>
+struct parallel_forward_output : std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<OutputIt>::iterator_category> {};
+
+template<typename InputIt, typename OutputIt, typename UnaryOp>
+void parallel_transform(InputIt first, InputIt last, OutputIt out, UnaryOp op, size_t grain = 0) {
+    static_assert(parallel_forward_output<OutputIt>::value, "parallel_transform needs a forward output iterator");
+    size_t count = (size_t)std::distance(first, last);
+    if(!grain) grain = parallel_grain_size(count, ZERO_PARALLEL_MIN_GRAIN);
+    grain = std::max(grain, (count + ZERO_PARALLEL_MAX_CHUNKS - 1) / ZERO_PARALLEL_MAX_CHUNKS);
+
+    if(count <= grain) {
+        std::transform(first, last, out, op);
+        return;
+    }
+
+    struct chunk_t {
+        InputIt first, last;
+        OutputIt out;
+        UnaryOp *op;
+
+        void operator()() { std::transform(first, last, out, *op); }
+    };
+
+    chunk_t chunks[ZERO_PARALLEL_MAX_CHUNKS];
+    job_group_t group;
+    job_group_init(&group);
+
+    size_t chunk_count = 0;
+    for(size_t begin = 0; begin < count; begin += grain) {
+        size_t end = std::min(begin + grain, count);
+        chunk_t *chunk = &chunks[chunk_count++];
+        chunk->first = std::next(first, begin);
+        chunk->last = std::next(first, end);
+        chunk->out = std::next(out, begin);
+        chunk->op = &op;
+
+        parallel_fork_leaf(&group, chunk, parallel_affinity(chunk_count - 1));
+    }
+
+    job_group_wait(&group);
+}
+
+// Merges the sorted halves of [first, first + count) by moving them
+// into the raw storage at [scratch] and back, leaving it raw again.
+template<typename RandomIt, typename Compare, typename T>
+static void parallel_merge(RandomIt first, size_t half, size_t count, T *scratch, Compare *comp) {
+    RandomIt left = first, left_last = first + half;
+    RandomIt right = left_last, right_last = first + count;
+    T *out = scratch;
+
+    // equal elements are taken from the left half first, like std::merge
+    while(left != left_last && right != right_last) {
+        if((*comp)(*right, *left)) {
+            ::new((void*)out++) T(std::move(*right++));
+        }
+        else {
+            ::new((void*)out++) T(std::move(*left++));
+        }
+    }
+    out = std::uninitialized_move(left, left_last, out);
+    std::uninitialized_move(right, right_last, out);
+
+    std::move(scratch, scratch + count, first);
+    std::destroy(scratch, scratch + count);
+}
+
+// Sorts [first, first + count), forking the left half to the worker
+// [spread] / 2 places on so a subtree's [spread] workers are split
+// between its halves.
+template<typename RandomIt, typename Compare, typename T>
+static void parallel_sort_range(RandomIt first, size_t count, T *scratch, Compare *comp, size_t grain, size_t spread) {
+    if(count <= grain) {
+        std::sort(first, first + count, *comp);
+        return;
+    }
+
+    size_t half = count / 2;
+    size_t right_spread = spread / 2 ? spread / 2 : 1;
+
+    struct half_t {
+        RandomIt first;
+        size_t count;
+        T *scratch;
+        Compare *comp;
+        size_t grain;
+        size_t spread;
+
+        void operator()() { parallel_sort_range(first, count, scratch, comp, grain, spread); }
+    } left = { first, half, scratch, comp, grain, spread - spread / 2 };
+
+    job_group_t group;
+    job_group_init(&group);
+    parallel_fork(&group, &left, parallel_affinity(spread / 2));
+    parallel_sort_range(first + half, count - half, scratch + half, comp, grain, right_spread);
+    job_group_wait(&group);
+
+    parallel_merge(first, half, count, scratch, comp);
+}
+
+// Merge sort, the halves are sorted in parallel and merged by the job
+// that split them. Allocates one uninitialized scratch buffer the size
+// of the range, so like std::sort it only needs [T] to be movable.
+template<typename RandomIt, typename Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp = Compare(), size_t grain = 0) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+
+    size_t count = (size_t)(last - first);
+    if(!grain) grain = parallel_grain_size(count, ZERO_PARALLEL_MIN_GRAIN);
+
+    if(count <= grain) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::allocator<T> allocator;
+    T *scratch = allocator.allocate(count);
+    parallel_sort_range(first, count, scratch, &comp, grain, (size_t)jobs_worker_count());
+    allocator.deallocate(scratch, count);
+}
+
+// Blocked scan: chunks are reduced in parallel, the chunk totals are
+// scanned sequentially and then every chunk is scanned in parallel
+// starting from the total of the chunks before it.
+template<typename InputIt, typename OutputIt, typename BinaryOp = std::plus<typename std::iterator_traits<InputIt>::value_type>>
+void parallel_scan(InputIt first, InputIt last, OutputIt out, BinaryOp op = BinaryOp(), size_t grain = 0) {
+    static_assert(parallel_forward_output<OutputIt>::value, "parallel_scan needs a forward output iterator");
+    typedef typename std::iterator_traits<InputIt>::value_type T;
+
+    size_t count = (size_t)std::distance(first, last);
+    if(!grain) grain = parallel_grain_size(count, ZERO_PARALLEL_MIN_GRAIN);
+    grain = std::max(grain, (count + ZERO_PARALLEL_MAX_CHUNKS - 1) / ZERO_PARALLEL_MAX_CHUNKS);
+
+    if(count <= grain) {
+        std::partial_sum(first, last, out, op);
+        return;
+    }
+
+    struct chunk_t {
+        InputIt first, last;
+        OutputIt out;
+        BinaryOp *op;
+        T total;
+        const T *offset;
+
+        void operator()() {
+            if(!offset) {
+                InputIt it = first;
+                total = *it;
+                for(++it; it != last; ++it) total = (*op)(total, *it);
+                return;
+            }
+
+            T running = *offset;
+            OutputIt o = out;
+            for(InputIt it = first; it != last; ++it, ++o) {
+                running = (*op)(running, *it);
+                *o = running;
+            }
+        }
+    };
+
+    chunk_t chunks[ZERO_PARALLEL_MAX_CHUNKS];
+    size_t chunk_count = 0;
+    for(size_t begin = 0; begin < count; begin += grain) {
+        size_t end = std::min(begin + grain, count);
+        chunk_t *chunk = &chunks[chunk_count++];
+        chunk->first = std::next(first, begin);
+        chunk->last = std::next(first, end);
+        chunk->out = std::next(out, begin);
+        chunk->op = &op;
+        chunk->offset = nullptr;
+    }
+
+    // the first chunk has nothing to add on, so it is scanned directly
+    // while the others are reduced
+    job_group_t group;
+    job_group_init(&group);
+    for(size_t i = 1; i < chunk_count; i++) {
+        parallel_fork_leaf(&group, &chunks[i], parallel_affinity(i));
+    }
+    std::partial_sum(chunks[0].first, chunks[0].last, chunks[0].out, op);
+    job_group_wait(&group);
+
+    // turn each chunk's total into the scan up to and including it
+    chunks[0].total = *std::next(out, (size_t)std::distance(chunks[0].first, chunks[0].last) - 1);
+    for(size_t i = 1; i < chunk_count; i++) {
+        chunks[i].total = op(chunks[i - 1].total, chunks[i].total);
+    }
+
+    job_group_init(&group);
+    for(size_t i = 1; i < chunk_count; i++) {
+        chunks[i].offset = &chunks[i - 1].total;
+        parallel_fork_leaf(&group, &chunks[i], parallel_affinity(i));
+    }
+    job_group_wait(&group);
+}
+
+#endif // ZERO_PARALLEL_INCLUDED
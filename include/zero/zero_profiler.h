@@ -0,0 +1,276 @@
+#ifndef ZERO_PROFILER_INCLUDED
+/*
+    zero_profiler.h    -- fiber aware sampling profiler
+
+    Project URL: https://github.com/zerotri/zero
+
+    Do this:
+        #define ZERO_PROFILER_IMPL
+    before you include this file in *one* C++ file to create the
+    implementation.
+
+    Samples every thread using CPU time with SIGPROF. Each sample holds
+    the description of the fiber the thread was running and a frame
+    pointer walk of its stack, bounded by the fiber's stack so a
+    broken chain can't fault. Build with -fno-omit-frame-pointer for
+    full stacks, without frame pointers only the sampled function is
+    seen. Samples go into a fixed buffer claimed with an atomic
+    increment, samples past its end are counted as dropped.
+
+    Supported on x86_64 Linux, zero_profiler_start returns -1 elsewhere.
+
+    int zero_profiler_start(int frequency);
+        Start sampling [frequency] times per second of CPU time. Also
+        calls zero_profiler_thread_enter for the calling thread.
+
+    void zero_profiler_stop(void);
+
+    void zero_profiler_thread_enter(void);
+        Record the calling thread's own stack bounds. Samples taken
+        while a thread runs outside of any fiber are only walked on
+        threads that did this, otherwise only the sampled function is
+        recorded.
+
+    int zero_profiler_write_folded(FILE *out);
+        Write the samples as folded stacks, one "fiber;outer;...;inner
+        count" line per distinct stack, ready for flamegraph.pl. Fibers
+        without a description show up as "fiber", code not running in a
+        fiber as "thread". Returns the number of lines written.
+
+    size_t zero_profiler_sample_count(void);
+    size_t zero_profiler_dropped(void);
+    void zero_profiler_reset(void);
+        Forget all samples, only while sampling is stopped.
+*/
+
+#define ZERO_PROFILER_INCLUDED (1)
+#include <stdio.h>
+#include <stddef.h>
+
+#include "zero_fiber.h"
+
+int zero_profiler_start(int frequency);
+void zero_profiler_stop(void);
+void zero_profiler_thread_enter(void);
+int zero_profiler_write_folded(FILE *out);
+size_t zero_profiler_sample_count(void);
+size_t zero_profiler_dropped(void);
+void zero_profiler_reset(void);
+
+#endif // ZERO_PROFILER_INCLUDED
+
+
+/*-- IMPLEMENTATION ----------------------------------------------------------*/
+#if defined(ZERO_PROFILER_IMPL) && !defined(ZERO_PROFILER_IMPL_INCLUDED)
+#define ZERO_PROFILER_IMPL_INCLUDED (1)
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+#include "zero_atomic.h"
+
+#ifndef ZERO_PROFILER_MAX_SAMPLES
+#define ZERO_PROFILER_MAX_SAMPLES (16384)
+#endif
+
+#ifndef ZERO_PROFILER_MAX_DEPTH
+#define ZERO_PROFILER_MAX_DEPTH (48)
+#endif
+
+#if defined(ZERO_FIBER_X86_64) && defined(ZERO_FIBER_LINUX)
+#define ZERO_PROFILER_SUPPORTED (1)
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include <cxxabi.h>
+#endif
+
+struct zero_profiler_sample_t {
+    ZERO_ATOMIC(int) ready;
+    const char *description;
+    int depth;
+    // innermost first
+    void *frames[ZERO_PROFILER_MAX_DEPTH];
+};
+
+static zero_profiler_sample_t zero_profiler_samples[ZERO_PROFILER_MAX_SAMPLES];
+static ZERO_ATOMIC(size_t) zero_profiler_cursor = 0;
+static ZERO_ATOMIC(size_t) zero_profiler_dropped_count = 0;
+static int zero_profiler_running = 0;
+
+// the thread's own stack, for samples taken outside of any fiber
+static thread_local char *zero_profiler_thread_low = NULL;
+static thread_local char *zero_profiler_thread_high = NULL;
+
+#if ZERO_PROFILER_SUPPORTED
+static void zero_profiler_signal(int signal, siginfo_t *info, void *ucontext) {
+    (void)signal;
+    (void)info;
+    int saved_errno = errno;
+
+    size_t index = ZERO_ATOMIC_INCREMENT(&zero_profiler_cursor);
+    if(index >= ZERO_PROFILER_MAX_SAMPLES) {
+        ZERO_ATOMIC_INCREMENT(&zero_profiler_dropped_count);
+        errno = saved_errno;
+        return;
+    }
+
+    zero_profiler_sample_t *sample = &zero_profiler_samples[index];
+    const mcontext_t *mcontext = &((ucontext_t*)ucontext)->uc_mcontext;
+    struct zero_fiber_t *fiber = zero_fiber_running();
+
+    char *low = zero_profiler_thread_low;
+    char *high = zero_profiler_thread_high;
+    if(fiber && zero_fiber_stack_bounds(fiber, (void**)&low, (void**)&high) == 0) {
+        sample->description = fiber->description && fiber->description[0] ? fiber->description : "fiber";
+    }
+    else {
+        sample->description = fiber && fiber->description ? fiber->description : "thread";
+    }
+
+    sample->frames[0] = (void*)mcontext->gregs[REG_RIP];
+    sample->depth = 1 + zero_fiber_frame_walk((void*)mcontext->gregs[REG_RBP], low, high,
+                                              sample->frames + 1, ZERO_PROFILER_MAX_DEPTH - 1);
+
+    ZERO_ATOMIC_STORE(&sample->ready, 1);
+    errno = saved_errno;
+}
+#endif
+
+void zero_profiler_thread_enter(void) {
+#if ZERO_PROFILER_SUPPORTED
+    pthread_attr_t attr;
+    void *stack = NULL;
+    size_t size = 0;
+
+    if(pthread_getattr_np(pthread_self(), &attr) != 0) return;
+    if(pthread_attr_getstack(&attr, &stack, &size) == 0) {
+        zero_profiler_thread_low = (char*)stack;
+        zero_profiler_thread_high = (char*)stack + size;
+    }
+    pthread_attr_destroy(&attr);
+#endif
+}
+
+int zero_profiler_start(int frequency) {
+#if ZERO_PROFILER_SUPPORTED
+    if(frequency <= 0 || zero_profiler_running) return -1;
+
+    zero_profiler_thread_enter();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = zero_profiler_signal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGPROF, &action, NULL) != 0) return -1;
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = frequency >= 1000000 ? 1 : 1000000 / frequency;
+    timer.it_value = timer.it_interval;
+    if(setitimer(ITIMER_PROF, &timer, NULL) != 0) return -1;
+
+    zero_profiler_running = 1;
+    return 0;
+#else
+    (void)frequency;
+    return -1;
+#endif
+}
+
+void zero_profiler_stop(void) {
+#if ZERO_PROFILER_SUPPORTED
+    if(!zero_profiler_running) return;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    // a signal already on its way shouldn't kill the process
+    signal(SIGPROF, SIG_IGN);
+    zero_profiler_running = 0;
+#endif
+}
+
+size_t zero_profiler_sample_count(void) {
+    size_t count = ZERO_ATOMIC_LOAD(&zero_profiler_cursor);
+    return count < ZERO_PROFILER_MAX_SAMPLES ? count : ZERO_PROFILER_MAX_SAMPLES;
+}
+
+size_t zero_profiler_dropped(void) {
+    return ZERO_ATOMIC_LOAD(&zero_profiler_dropped_count);
+}
+
+void zero_profiler_reset(void) {
+    if(zero_profiler_running) return;
+
+    size_t count = zero_profiler_sample_count();
+    for(size_t i = 0; i < count; i++) {
+        zero_profiler_samples[i].ready = 0;
+    }
+    zero_profiler_cursor = 0;
+    zero_profiler_dropped_count = 0;
+}
+
+// [address] is a return address unless it is the sampled pc, step back
+// into the call instruction so it resolves to the calling function
+static std::string zero_profiler_symbol(void *address, bool return_address) {
+    char buffer[32];
+#if ZERO_PROFILER_SUPPORTED
+    Dl_info info;
+    void *lookup = return_address ? (void*)((char*)address - 1) : address;
+
+    if(dladdr(lookup, &info) && info.dli_sname) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        free(demangled);
+
+        // folded stacks use ';' between frames
+        for(size_t i = 0; i < name.size(); i++) {
+            if(name[i] == ';') name[i] = ':';
+        }
+        return name;
+    }
+#endif
+    snprintf(buffer, sizeof(buffer), "%p", address);
+    return buffer;
+}
+
+int zero_profiler_write_folded(FILE *out) {
+    std::map<std::string, size_t> stacks;
+    std::map<void*, std::string> symbols[2];
+
+    size_t count = zero_profiler_sample_count();
+    for(size_t i = 0; i < count; i++) {
+        zero_profiler_sample_t *sample = &zero_profiler_samples[i];
+        if(!ZERO_ATOMIC_LOAD(&sample->ready)) continue;
+
+        std::string stack = sample->description;
+        for(int frame = sample->depth - 1; frame >= 0; frame--) {
+            bool return_address = frame > 0;
+            void *address = sample->frames[frame];
+
+            auto symbol = symbols[return_address].find(address);
+            if(symbol == symbols[return_address].end()) {
+                symbol = symbols[return_address].emplace(address, zero_profiler_symbol(address, return_address)).first;
+            }
+
+            stack += ';';
+            stack += symbol->second;
+        }
+        stacks[stack]++;
+    }
+
+    for(auto &stack : stacks) {
+        fprintf(out, "%s %zu\n", stack.first.c_str(), stack.second);
+    }
+    return (int)stacks.size();
+}
+
+#endif // ZERO_PROFILER_IMPL
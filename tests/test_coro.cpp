@@ -0,0 +1,163 @@
+#include <doctest/doctest.h>
+#include <zero/zero_coro.h>
+
+#if defined(__cpp_impl_coroutine)
+
+static job_task<int> coro_double_later(int value) {
+    co_await job_sleep(0.1);
+    co_return value * 2;
+}
+
+static job_task<> coro_sleeper(int *steps) {
+    for(int i = 0; i < 3; i++) {
+        co_await job_sleep(0.5);
+        (*steps)++;
+    }
+}
+
+static job_task<> coro_chain(int *result) {
+    int first = co_await coro_double_later(3);
+    int second = co_await coro_double_later(first);
+    *result = second;
+}
+
+static job_task<> coro_counter_waiter(ZERO_ATOMIC(int) *counter, int *result) {
+    *result = co_await job_until_zero(counter);
+}
+
+static job_task<> coro_timeout(ZERO_ATOMIC(int) *counter, int *result) {
+    *result = co_await job_until_zero(counter, 0.25);
+}
+
+static job_task<> coro_passes(int *passes) {
+    for(int i = 0; i < 5; i++) {
+        co_await job_next_pass();
+        (*passes)++;
+    }
+}
+
+static int coro_fiber_done = 0;
+static void *coro_fiber_job(void*) {
+    job_wait(0.2);
+    coro_fiber_done = 1;
+    return nullptr;
+}
+
+TEST_CASE("Coroutine tasks") {
+    job_pool_init();
+
+    double time = 0.0;
+    double time_step = 1.0 / 120.0;
+    ZERO_ATOMIC(int) done = 0;
+
+    SUBCASE("timers resume on the scheduler's clock") {
+        int steps = 0;
+        job_spawn(coro_sleeper(&steps), &done);
+        REQUIRE(done == 1);
+
+        while(time < 1.2) {
+            jobs_run(time);
+            time += time_step;
+        }
+        REQUIRE(steps == 2);
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        REQUIRE(steps == 3);
+        REQUIRE(time >= 1.5);
+    }
+
+    SUBCASE("awaiting a task returns its value") {
+        int result = 0;
+        job_spawn(coro_chain(&result), &done);
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        REQUIRE(result == 12);
+    }
+
+    SUBCASE("tasks and fiber jobs wait on each other's counters") {
+        ZERO_ATOMIC(int) fibers = 0;
+        int result = -1;
+
+        coro_fiber_done = 0;
+        job_create(coro_fiber_job, &fibers);
+        job_spawn(coro_counter_waiter(&fibers, &result), &done);
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        REQUIRE(coro_fiber_done == 1);
+        REQUIRE(result == JOB_WAIT_OK);
+    }
+
+    SUBCASE("counter waits time out") {
+        ZERO_ATOMIC(int) never = 1;
+        int result = -1;
+        job_spawn(coro_timeout(&never, &result), &done);
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        REQUIRE(result == JOB_WAIT_TIMED_OUT);
+        REQUIRE(time >= 0.25);
+    }
+
+    SUBCASE("next pass resumes once per jobs_run") {
+        int passes = 0;
+        job_spawn(coro_passes(&passes), &done);
+
+        jobs_run(time);
+        REQUIRE(passes == 0);
+        jobs_run(time);
+        REQUIRE(passes == 1);
+        for(int i = 0; i < 4; i++) jobs_run(time);
+        REQUIRE(passes == 5);
+        REQUIRE(done == 0);
+    }
+
+    SUBCASE("many tasks are cheap") {
+        int steps[512] = { 0 };
+        for(int i = 0; i < 512; i++) {
+            job_spawn(coro_sleeper(&steps[i]), &done);
+        }
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        for(int i = 0; i < 512; i++) {
+            REQUIRE(steps[i] == 3);
+        }
+    }
+
+    SUBCASE("more tasks can be suspended than the inline pool holds") {
+        enum { TASKS = ZERO_JOBS_INLINE_COUNT + 256 };
+        static int steps[TASKS];
+        memset(steps, 0, sizeof(steps));
+        for(int i = 0; i < TASKS; i++) {
+            job_spawn(coro_sleeper(&steps[i]), &done);
+        }
+        REQUIRE(done == TASKS);
+
+        while(done) {
+            jobs_run(time);
+            time += time_step;
+        }
+        for(int i = 0; i < TASKS; i++) {
+            REQUIRE(steps[i] == 3);
+        }
+
+        job_pool_stats_t stats;
+        job_pool_stats(JOB_POOL_INLINE, &stats);
+        REQUIRE(stats.in_use == 0);
+    }
+}
+
+#endif // __cpp_impl_coroutine
@@ -2,6 +2,7 @@
 #define ZERO_FIBER_DEBUG 1
 #include <zero/zero_fiber.h>
 #include <iostream>
+#include <thread>
 
 TEST_CASE("Fibers") {
     SUBCASE("Run basic fiber") {
@@ -22,4 +23,135 @@ TEST_CASE("Fibers") {
         REQUIRE(zero_fiber_resume(fiber, (zero_userdata_t) 3) == (zero_userdata_t) 3);
         REQUIRE(zero_fiber_resume(fiber, (zero_userdata_t) 4) == (zero_userdata_t) 1);
     }
+
+    SUBCASE("Shared-stack fibers keep their frames across switches") {
+        auto fiber_shared = [](zero_userdata_t data) -> zero_userdata_t {
+            uint64_t seed = (uint64_t) data;
+            volatile uint64_t scratch[64];
+            for(int i = 0; i < 64; i++) scratch[i] = seed * 64 + i;
+
+            for(int round = 0; round < 4; round++) {
+                zero_fiber_yield((zero_userdata_t) seed);
+            }
+
+            uint64_t sum = 0;
+            for(int i = 0; i < 64; i++) sum += scratch[i] - seed * 64;
+            return (zero_userdata_t) sum;
+        };
+
+        zero_fiber_t* fibers[16];
+        for(uint64_t i = 0; i < 16; i++) {
+            fibers[i] = zero_fiber_make_shared("fiber_shared", fiber_shared, (zero_userdata_t) i);
+        }
+
+        for(int round = 0; round < 4; round++) {
+            for(uint64_t i = 0; i < 16; i++) {
+                REQUIRE(zero_fiber_resume(fibers[i], (zero_userdata_t) i) == (zero_userdata_t) i);
+            }
+        }
+        for(uint64_t i = 0; i < 16; i++) {
+            REQUIRE(zero_fiber_resume(fibers[i], NULL) == (zero_userdata_t) 2016);
+            REQUIRE_FALSE(zero_fiber_is_active(fibers[i]));
+#if defined(ZERO_FIBER_X86_64)
+            REQUIRE(fibers[i]->stack_copy_size < 4 * 1024);
+#endif
+            zero_fiber_delete(fibers[i]);
+        }
+    }
+
+#if defined(ZERO_FIBER_X86_64)
+    SUBCASE("A shared fiber reused on another thread is no longer evicted here") {
+        auto yield_once = [](zero_userdata_t data) -> zero_userdata_t {
+            zero_fiber_yield(NULL);
+            return data;
+        };
+
+        // this thread's shared stack is left owned by [reused]
+        zero_fiber_t* reused = zero_fiber_make_shared("reused", yield_once, NULL);
+        zero_fiber_resume(reused, NULL);
+        zero_fiber_resume(reused, NULL);
+        REQUIRE_FALSE(zero_fiber_is_active(reused));
+
+        // the pool hands it to another thread, where it is suspended
+        std::thread other([reused, yield_once] {
+            zero_fiber_reset(reused, yield_once, NULL);
+            zero_fiber_resume(reused, NULL);
+        });
+        other.join();
+        REQUIRE(zero_fiber_is_active(reused));
+
+        // taking this thread's stack over must leave it alone
+        zero_fiber_t* next = zero_fiber_make_shared("next", yield_once, NULL);
+        zero_fiber_resume(next, NULL);
+        REQUIRE(reused->stack_copy_size == 0);
+
+        zero_fiber_resume(next, NULL);
+        zero_fiber_delete(next);
+        zero_fiber_delete(reused);
+    }
+#endif
+
+    SUBCASE("Fiber-local slots belong to the fiber, not the thread") {
+        static int key = -1;
+        if(key < 0) key = zero_fiber_local_key();
+        REQUIRE(key >= 0);
+
+        zero_fiber_local_set(key, (zero_userdata_t) 1);
+
+        auto fiber_local = [](zero_userdata_t data) -> zero_userdata_t {
+            REQUIRE(zero_fiber_local_get(key) == NULL);
+            zero_fiber_local_set(key, data);
+            zero_fiber_yield(NULL);
+            return zero_fiber_local_get(key);
+        };
+
+        zero_fiber_t* a = zero_fiber_make("local_a", 16 * 1024, fiber_local, (zero_userdata_t) 10);
+        zero_fiber_t* b = zero_fiber_make("local_b", 16 * 1024, fiber_local, (zero_userdata_t) 20);
+        zero_fiber_resume(a, (zero_userdata_t) 10);
+        zero_fiber_resume(b, (zero_userdata_t) 20);
+        REQUIRE(zero_fiber_local_get(key) == (zero_userdata_t) 1);
+        REQUIRE(zero_fiber_resume(a, NULL) == (zero_userdata_t) 10);
+        REQUIRE(zero_fiber_resume(b, NULL) == (zero_userdata_t) 20);
+
+        // a recycled fiber starts with empty slots
+        zero_fiber_reset(a, fiber_local, (zero_userdata_t) 30);
+        zero_fiber_resume(a, (zero_userdata_t) 30);
+        REQUIRE(zero_fiber_resume(a, NULL) == (zero_userdata_t) 30);
+
+        zero_fiber_local_set(key, NULL);
+        zero_fiber_delete(a);
+        zero_fiber_delete(b);
+    }
+
+    SUBCASE("Fibers built in caller memory stay inside it") {
+        const size_t slot_size = 32 * 1024;
+        char *slab = (char*) malloc(2 * slot_size);
+
+        auto deep = [](zero_userdata_t data) -> zero_userdata_t {
+            volatile char buffer[8 * 1024];
+            buffer[0] = (char)(intptr_t)data;
+            zero_fiber_yield(NULL);
+            return (zero_userdata_t)(intptr_t)(buffer[0] + 1);
+        };
+
+        zero_fiber_t* fibers[2];
+        for(int i = 0; i < 2; i++) {
+            fibers[i] = zero_fiber_make_in(slab + i * slot_size, slot_size, "slab", deep, (zero_userdata_t)(intptr_t)i);
+            REQUIRE(fibers[i] == (zero_fiber_t*)(slab + i * slot_size));
+
+            void *low = NULL, *high = NULL;
+            REQUIRE(zero_fiber_stack_bounds(fibers[i], &low, &high) == 0);
+            REQUIRE((char*)low > slab + i * slot_size);
+            REQUIRE((char*)high == slab + (i + 1) * slot_size);
+        }
+
+        for(int i = 0; i < 2; i++) zero_fiber_resume(fibers[i], (zero_userdata_t)(intptr_t)i);
+        for(int i = 0; i < 2; i++) {
+            REQUIRE(zero_fiber_resume(fibers[i], NULL) == (zero_userdata_t)(intptr_t)(i + 1));
+            zero_fiber_delete(fibers[i]);
+        }
+
+        REQUIRE(zero_fiber_make_in(slab, 1024, "tiny", deep, NULL) == NULL);
+        free(slab);
+    }
 }
@@ -2,11 +2,21 @@
 //#define ZERO_FIBER_DEBUG 1
 #include <zero/zero_jobs.h>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <time.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 int counter = 0;
 void *counter_job(void*) {
-    while(true) {
-        job_yield();
+    while(job_yield() != JOB_WAIT_CANCELLED) {
         counter++;
 //        job_wait(1.0/500.0);
     }
@@ -31,10 +41,9 @@ TEST_CASE("Jobs") {
 
     SUBCASE("Run basic job") {
         job_create(basic_job, nullptr);
-        job_create(counter_job, nullptr);
-        job_create([](zero_userdata_t data) -> zero_userdata_t {
-                while(true) {
-                    job_wait(1.0);
+        job_t *counting = job_create(counter_job, nullptr);
+        job_t *checking = job_create([](zero_userdata_t data) -> zero_userdata_t {
+                while(job_wait(1.0) != JOB_WAIT_CANCELLED) {
                     int counter_value = counter;
                     counter = 0;
                     REQUIRE(counter_value == 120);
@@ -53,6 +62,982 @@ TEST_CASE("Jobs") {
             time += time_step;
 //            std::cout << std::endl;
         }
+
+        job_cancel(counting);
+        job_cancel(checking);
+        jobs_run(time);
+        REQUIRE(jobs.size() == 0);
+        REQUIRE(waiting_jobs.size() == 0);
+    }
+
+    SUBCASE("Cancelled job is reclaimed without running") {
+        static bool ran = false;
+        ZERO_ATOMIC(int) pending = 0;
+
+        job_t *job = job_create([](zero_userdata_t) -> zero_userdata_t {
+                ran = true;
+                return nullptr;
+            }, &pending);
+        REQUIRE(pending == 1);
+
+        job_cancel(job);
+        jobs_run(latest_time);
+
+        REQUIRE_FALSE(ran);
+        REQUIRE(pending == 0);
+    }
+
+    SUBCASE("Timed waits resume with a result") {
+        static ZERO_ATOMIC(int) blocker = 1;
+        static int timed_result = -1;
+        static int cancelled_result = -1;
+
+        job_create([](zero_userdata_t) -> zero_userdata_t {
+                timed_result = job_wait_on_condition_timeout(&blocker, 0.5);
+                return nullptr;
+            }, nullptr);
+        job_t *parked = job_create([](zero_userdata_t) -> zero_userdata_t {
+                cancelled_result = job_wait_zero((void*)&blocker);
+                return nullptr;
+            }, nullptr);
+
+        double time = latest_time;
+        jobs_run(time);
+        jobs_run(time + 0.25);
+        REQUIRE(timed_result == -1);
+        jobs_run(time + 0.5);
+        REQUIRE(timed_result == JOB_WAIT_TIMED_OUT);
+
+        REQUIRE(cancelled_result == -1);
+        job_cancel(parked);
+        jobs_run(time + 0.5);
+        REQUIRE(cancelled_result == JOB_WAIT_CANCELLED);
+    }
+
+    SUBCASE("Group waits for all of its children") {
+        static ZERO_ATOMIC(int) children_done = 0;
+        static int parent_result = -1;
+
+        job_create([](zero_userdata_t) -> zero_userdata_t {
+                job_group_t group;
+                job_group_init(&group);
+                for(int i = 0; i < 8; i++) {
+                    job_group_create(&group, [](zero_userdata_t) -> zero_userdata_t {
+                            job_wait(0.0);
+                            ZERO_ATOMIC_INCREMENT(&children_done);
+                            return nullptr;
+                        }, nullptr);
+                }
+                parent_result = job_group_wait(&group);
+                return nullptr;
+            }, nullptr);
+
+        jobs_run(latest_time);
+        REQUIRE(parent_result == JOB_WAIT_OK);
+        REQUIRE(children_done == 8);
+    }
+
+    SUBCASE("Cancelling a group reaches nested groups") {
+        static int leaves_run = 0;
+        static int inner_result = -1;
+        job_group_t outer;
+        job_group_init(&outer);
+
+        job_group_create(&outer, [](zero_userdata_t) -> zero_userdata_t {
+                job_group_t inner;
+                job_group_init(&inner);
+                for(int i = 0; i < 4; i++) {
+                    job_group_create(&inner, [](zero_userdata_t) -> zero_userdata_t {
+                            leaves_run++;
+                            return nullptr;
+                        }, nullptr);
+                }
+                job_group_cancel(job_current->group);
+                inner_result = job_group_wait(&inner);
+                return nullptr;
+            }, nullptr);
+
+        REQUIRE(job_group_wait(&outer) == JOB_WAIT_CANCELLED);
+        REQUIRE(outer.pending == 0);
+        REQUIRE(leaves_run == 0);
+        REQUIRE(inner_result == JOB_WAIT_CANCELLED);
+    }
+
+    SUBCASE("Inline jobs run on the scheduler stack") {
+        static int sum = 0;
+        static zero_fiber_t *ran_on = nullptr;
+        job_group_t group;
+        job_group_init(&group);
+
+        for(int i = 1; i <= 100; i++) {
+            job_group_create_inline(&group, [](zero_userdata_t data) -> zero_userdata_t {
+                    sum += (int)(intptr_t)data;
+                    ran_on = zero_fiber_active();
+                    return nullptr;
+                }, (zero_userdata_t)(intptr_t)i);
+        }
+
+        REQUIRE(job_group_wait(&group) == JOB_WAIT_OK);
+        REQUIRE(sum == 5050);
+        REQUIRE(ran_on == zero_fiber_active());
+    }
+
+    SUBCASE("Shared-stack jobs") {
+        static int woken = 0;
+        job_group_t group;
+        job_group_init(&group);
+
+        for(int i = 0; i < 512; i++) {
+            job_group_create_shared(&group, [](zero_userdata_t) -> zero_userdata_t {
+                    job_wait(0.5);
+                    woken++;
+                    return nullptr;
+                }, nullptr);
+        }
+
+        double time = latest_time;
+        jobs_run(time);
+        REQUIRE(group.pending == 512);
+        jobs_run(time + 0.5);
+        REQUIRE(group.pending == 0);
+        REQUIRE(woken == 512);
+    }
+
+    SUBCASE("Frame arena memory lives for two frames") {
+        jobs_frame_boundary();
+
+        int *first = (int*)job_arena_alloc(sizeof(int) * 4, alignof(int));
+        REQUIRE(first != nullptr);
+        first[0] = 42;
+
+        char *big = (char*)job_arena_alloc(ZERO_JOBS_ARENA_SIZE * 2, 64);
+        REQUIRE(big != nullptr);
+        REQUIRE(((uintptr_t)big & 63) == 0);
+        big[ZERO_JOBS_ARENA_SIZE * 2 - 1] = 1;
+
+        jobs_frame_boundary();
+        int *second = (int*)job_arena_alloc(sizeof(int) * 4, alignof(int));
+        REQUIRE(second != first);
+        REQUIRE(first[0] == 42);
+
+        jobs_frame_boundary();
+        REQUIRE((int*)job_arena_alloc(sizeof(int) * 4, alignof(int)) == first);
+    }
+
+    SUBCASE("Pinned job only runs on its worker") {
+        static ZERO_ATOMIC(int) ran_on_worker = -1;
+        ZERO_ATOMIC(int) done = 0;
+
+        size_t local_jobs = jobs.size();
+        job_create([](zero_userdata_t) -> zero_userdata_t {
+                ZERO_ATOMIC_SWAP(&ran_on_worker, job_worker_index);
+                return nullptr;
+            }, nullptr, JOB_AFFINITY_WORKER(1));
+        REQUIRE(jobs.size() == local_jobs);
+
+        std::thread worker([&done]() {
+            jobs_worker_enter(1);
+            while(ZERO_ATOMIC_LOAD(&ran_on_worker) < 0) {
+                jobs_run(0.0);
+            }
+            jobs_worker_exit();
+            ZERO_ATOMIC_SWAP(&done, 1);
+        });
+        worker.join();
+
+        REQUIRE(ZERO_ATOMIC_LOAD(&done) == 1);
+        REQUIRE(ZERO_ATOMIC_LOAD(&ran_on_worker) == 1);
+    }
+
+    SUBCASE("Preferred job stays local when its worker is absent") {
+        size_t local_jobs = jobs.size();
+        job_create([](zero_userdata_t) -> zero_userdata_t { return nullptr; },
+                   nullptr, JOB_AFFINITY_WORKER(5) | JOB_AFFINITY_PREFER);
+        REQUIRE(jobs.size() == local_jobs + 1);
+    }
+
+    SUBCASE("Perf counters are attributed to descriptions") {
+        jobs_run(0.0);
+        jobs_perf_reset();
+        int counters = jobs_perf_enable();
+
+        auto spin = [](zero_userdata_t) -> zero_userdata_t {
+            volatile int sum = 0;
+            for(int i = 0; i < 10000; i++) sum = sum + i;
+            return nullptr;
+        };
+        job_describe(job_create(spin, nullptr), "spin");
+        job_describe(job_create_inline(spin, nullptr, nullptr), "spin");
+        jobs_run(0.0);
+
+        job_perf_stats_t stats[ZERO_JOBS_PERF_ENTRIES];
+        int count = jobs_perf_stats(stats, ZERO_JOBS_PERF_ENTRIES);
+        if(!counters) {
+            // perf events aren't permitted here, nothing is recorded
+            REQUIRE(count == 0);
+        }
+        else {
+            REQUIRE(count == 1);
+            REQUIRE(stats[0].runs == 2);
+            REQUIRE(strcmp(stats[0].description, "spin") == 0);
+            if(counters & JOB_PERF_INSTRUCTIONS) {
+                REQUIRE(stats[0].instructions > 0);
+            }
+        }
+
+        jobs_perf_disable();
+        jobs_perf_reset();
+    }
+
+    SUBCASE("Watchdog reports a job that doesn't yield") {
+        static job_stall_t stall;
+        static int stalls;
+        stalls = 0;
+
+        jobs_run(0.0);
+        jobs_stats_reset();
+        REQUIRE(jobs_watchdog_start(20000000, [](const job_stall_t *s, void*) {
+            stall = *s;
+            stalls++;
+        }, nullptr, 1) == 0);
+
+        job_describe(job_create([](zero_userdata_t) -> zero_userdata_t {
+            uint64_t until = jobs_clock_ns() + 100000000;
+            while(jobs_clock_ns() < until) {
+            }
+            return nullptr;
+        }, nullptr), "hog");
+        jobs_run(0.0);
+        jobs_watchdog_stop();
+
+        REQUIRE(stalls == 1);
+        REQUIRE(strcmp(stall.description, "hog") == 0);
+        REQUIRE(stall.worker == 0);
+        REQUIRE(stall.resumes == 1);
+        REQUIRE(stall.running_ns >= 20000000);
+        REQUIRE(stall.depth >= 1);
+
+        jobs_stats_t stats;
+        jobs_stats(&stats);
+        REQUIRE(stats.passes == 1);
+        REQUIRE(stats.max_pass_ns >= 100000000);
+        REQUIRE(stats.resumes >= 1);
+    }
+
+    SUBCASE("Run until idle sleeps until the next deadline") {
+        jobs_run(0.0);
+        REQUIRE(jobs_next_deadline() == JOB_WAIT_FOREVER);
+
+        job_create([](zero_userdata_t) -> zero_userdata_t {
+            job_wait(0.05);
+            job_wait(0.05);
+            return nullptr;
+        }, nullptr);
+
+        double start = jobs_clock();
+        clock_t cpu_start = clock();
+        jobs_run(start);
+        REQUIRE(jobs_next_deadline() == doctest::Approx(start + 0.05));
+
+        jobs_run_until_idle();
+        double elapsed = jobs_clock() - start;
+        double cpu = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+        REQUIRE(elapsed >= 0.1 - ZERO_JOBS_TIMING_ERROR);
+        REQUIRE(cpu < elapsed / 2);
+        REQUIRE(waiting_jobs.size() == 0);
+        REQUIRE(jobs_next_deadline() == JOB_WAIT_FOREVER);
+    }
+
+    SUBCASE("Run until idle serves until stopped") {
+        static ZERO_ATOMIC(int) stop;
+        static int ran;
+        stop = 0;
+        ran = 0;
+
+        std::thread producer([] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            job_create([](zero_userdata_t) -> zero_userdata_t {
+                ran++;
+                return nullptr;
+            }, nullptr, JOB_AFFINITY_MAIN);
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            ZERO_ATOMIC_SWAP(&stop, 1);
+            jobs_wake(0);
+        });
+
+        jobs_run_until_idle(&stop);
+        producer.join();
+        REQUIRE(ran == 1);
+    }
+
+    SUBCASE("Periodic jobs tick on their grid and coalesce missed ticks") {
+        static int ticks;
+        ticks = 0;
+
+        double start = latest_time;
+        job_periodic_t *periodic = job_periodic_create([](zero_userdata_t) -> zero_userdata_t {
+            ticks++;
+            return nullptr;
+        }, nullptr, 0.1, JOB_PERIODIC_INLINE);
+        REQUIRE(jobs_next_deadline() == doctest::Approx(start + 0.1));
+
+        jobs_run(start + 0.05);
+        REQUIRE(ticks == 0);
+        jobs_run(start + 0.1);
+        jobs_run(start + 0.2);
+        REQUIRE(ticks == 2);
+
+        // 0.3 to 0.6 are missed, 0.7 runs and the grid holds
+        jobs_run(start + 0.75);
+        REQUIRE(ticks == 3);
+        REQUIRE(periodic->missed == 4);
+        REQUIRE(periodic->next_time == doctest::Approx(start + 0.8));
+
+        // the cancelled tick is no longer a deadline, even before the
+        // next pass
+        job_periodic_cancel(periodic);
+        REQUIRE(jobs_next_deadline() == JOB_WAIT_FOREVER);
+        jobs_run(start + 0.8);
+        REQUIRE(ticks == 3);
+        REQUIRE(jobs_next_deadline() == JOB_WAIT_FOREVER);
+    }
+
+    SUBCASE("Periodic ticks skip while the last one is still running") {
+        static int started;
+        started = 0;
+
+        double start = latest_time;
+        job_periodic_t *periodic = job_periodic_create([](zero_userdata_t) -> zero_userdata_t {
+            started++;
+            job_wait(0.25);
+            return nullptr;
+        }, nullptr, 0.1);
+
+        for(int tick = 1; tick <= 5; tick++) {
+            jobs_run(start + tick * 0.1);
+        }
+        // 0.1 is parked until 0.35 and only finishes in the 0.4 pass,
+        // after that pass's tick was skipped, so 0.2 to 0.4 are skipped
+        REQUIRE(started == 2);
+        REQUIRE(periodic->ticks == 2);
+        REQUIRE(periodic->missed == 3);
+
+        // the record outlives the cancel until its last tick is done,
+        // but is out of the deadline heap right away
+        job_periodic_cancel(periodic);
+        REQUIRE(jobs_next_deadline() == doctest::Approx(start + 0.75));
+        jobs_run(start + 0.8);
+        REQUIRE(waiting_jobs.size() == 0);
+        REQUIRE(jobs_next_deadline() == JOB_WAIT_FOREVER);
+    }
+
+    SUBCASE("Pipelined frames overlap and order their stages") {
+        enum { STAGE_SIM, STAGE_RENDER };
+        static std::string log;
+        log.clear();
+
+        job_pipeline_t pipeline;
+        REQUIRE(job_pipeline_init(&pipeline, 2) == 0);
+
+        auto sim = [](zero_userdata_t data) -> zero_userdata_t {
+            job_frame_t *frame = (job_frame_t*)data;
+            log += "s" + std::to_string(frame->index) + " ";
+            return nullptr;
+        };
+        auto render = [](zero_userdata_t data) -> zero_userdata_t {
+            job_frame_t *frame = (job_frame_t*)data;
+            job_frame_wait_stage(job_frame_previous(frame), STAGE_RENDER);
+            if(frame->index == 0) job_wait(0.1);
+            log += "r" + std::to_string(frame->index) + " ";
+            return nullptr;
+        };
+
+        double start = latest_time;
+        job_frame_t *frame0 = job_frame_begin(&pipeline);
+        void *scratch = job_frame_alloc(frame0, 64);
+        job_frame_create_inline(frame0, STAGE_SIM, sim, frame0);
+        job_frame_create(frame0, STAGE_RENDER, render, frame0);
+        jobs_run(start);
+
+        // frame 1 runs while frame 0's render is still parked
+        job_frame_t *frame1 = job_frame_begin(&pipeline);
+        REQUIRE(job_frame_previous(frame1) == frame0);
+        job_frame_create_inline(frame1, STAGE_SIM, sim, frame1);
+        job_frame_create(frame1, STAGE_RENDER, render, frame1);
+        jobs_run(start);
+        REQUIRE(log == "s0 s1 ");
+        REQUIRE_FALSE(job_frame_done(frame0));
+
+        jobs_run(start + 0.1);
+        REQUIRE(log == "s0 s1 r0 r1 ");
+
+        // reuses frame 0's slot, whose arena was rewound
+        job_frame_t *frame2 = job_frame_begin(&pipeline);
+        REQUIRE(frame2 == frame0);
+        REQUIRE(frame2->index == 2);
+        REQUIRE(job_frame_previous(frame1) == nullptr);
+        REQUIRE(job_frame_alloc(frame2, 64) == scratch);
+
+        job_pipeline_destroy(&pipeline);
+    }
+
+    SUBCASE("Beginning a frame on a full ring lets stage timers fire") {
+        static int woke = 0;
+        woke = 0;
+
+        job_pipeline_t pipeline;
+        REQUIRE(job_pipeline_init(&pipeline, 1) == 0);
+
+        job_frame_t *frame0 = job_frame_begin(&pipeline);
+        job_frame_create(frame0, 0, [](zero_userdata_t) -> zero_userdata_t {
+            job_wait(0.01);
+            woke = 1;
+            return nullptr;
+        }, nullptr);
+
+        // waits for frame 0, whose only job is parked on a timer
+        job_frame_t *frame1 = job_frame_begin(&pipeline);
+        REQUIRE(woke == 1);
+        REQUIRE(frame1 == frame0);
+        REQUIRE(job_frame_wait_stage(frame1, 0) == JOB_WAIT_OK);
+
+        job_pipeline_destroy(&pipeline);
+    }
+
+    SUBCASE("Graph nodes only become jobs once their predecessors finish") {
+        static std::string order;
+        order.clear();
+
+        auto node = [](zero_userdata_t data) -> zero_userdata_t {
+            order += (char)(intptr_t)data;
+            return nullptr;
+        };
+
+        // a -> b, a -> c, b + c -> d
+        job_graph_t graph;
+        job_graph_init(&graph);
+        int a = job_graph_add(&graph, node, (zero_userdata_t)'a');
+        int b = job_graph_add(&graph, node, (zero_userdata_t)'b');
+        int c = job_graph_add(&graph, node, (zero_userdata_t)'c', JOB_GRAPH_INLINE);
+        int d = job_graph_add(&graph, node, (zero_userdata_t)'d');
+        REQUIRE(job_graph_depend(&graph, b, a) == 0);
+        REQUIRE(job_graph_depend(&graph, c, a) == 0);
+        REQUIRE(job_graph_depend(&graph, d, b) == 0);
+        REQUIRE(job_graph_depend(&graph, d, c) == 0);
+        REQUIRE(job_graph_build(&graph) == 0);
+
+        jobs_run(latest_time);
+        for(int run = 0; run < 3; run++) {
+            order.clear();
+            size_t queued = jobs.size();
+            REQUIRE(job_graph_submit(&graph) == 0);
+            REQUIRE(jobs.size() == queued + 1);
+            REQUIRE(job_graph_submit(&graph) == -1);
+
+            REQUIRE(job_graph_wait(&graph) == JOB_WAIT_OK);
+            REQUIRE(order.size() == 4);
+            REQUIRE(order[0] == 'a');
+            REQUIRE(order[3] == 'd');
+        }
+
+        REQUIRE(job_graph_depend(&graph, a, d) == 0);
+        REQUIRE(job_graph_build(&graph) == -1);
+        REQUIRE(job_graph_submit(&graph) == -1);
+    }
+
+    SUBCASE("Closures keep their captures in the job record") {
+        static int destroyed;
+        struct tracked_t {
+            int value;
+            explicit tracked_t(int value) : value(value) {}
+            tracked_t(tracked_t &&other) : value(other.value) { other.value = 0; }
+            ~tracked_t() { if(value) destroyed++; }
+        };
+
+        destroyed = 0;
+        ZERO_ATOMIC(int) done = 0;
+        int sum = 0;
+        int large[32];
+        for(int i = 0; i < 32; i++) large[i] = i;
+
+        std::unique_ptr<int> owned(new int(5));
+        job_t *small = job_create([&sum, owned = std::move(owned), tracked = tracked_t(3)]() {
+            job_wait(0.1);
+            sum += *owned + tracked.value;
+        }, &done);
+        REQUIRE(small);
+        REQUIRE(small->data == (zero_userdata_t)small->capture);
+
+        job_t *inline_job = job_create_inline([&sum, large]() {
+            for(int i = 0; i < 32; i++) sum += large[i];
+        }, &done);
+        REQUIRE(inline_job);
+        REQUIRE(inline_job->data != (zero_userdata_t)inline_job->capture);
+
+        double time = latest_time;
+        while(ZERO_ATOMIC_LOAD(&done)) {
+            jobs_run(time);
+            time += 1.0 / 60.0;
+        }
+        REQUIRE(sum == 8 + 31 * 32 / 2);
+        REQUIRE(destroyed == 1);
+    }
+
+    SUBCASE("Large captures outlive the frame arena") {
+        ZERO_ATOMIC(int) done = 0;
+        int sum = 0;
+        int large[32];
+        for(int i = 0; i < 32; i++) large[i] = i;
+
+        job_t *job = job_create([&sum, large]() {
+            job_wait(0.1);
+            for(int i = 0; i < 32; i++) sum += large[i];
+        }, &done);
+        REQUIRE(job);
+        REQUIRE(job->capture_block);
+
+        double time = latest_time;
+        jobs_run(time);
+
+        // every arena frame is rewound and scribbled over while it waits
+        for(int i = 0; i < ZERO_JOBS_ARENA_FRAMES + 1; i++) {
+            jobs_frame_boundary();
+            memset(job_arena_alloc(sizeof(large)), 0xff, sizeof(large));
+        }
+
+        while(ZERO_ATOMIC_LOAD(&done)) {
+            time += 1.0 / 60.0;
+            jobs_run(time);
+        }
+        REQUIRE(sum == 31 * 32 / 2);
+    }
+
+    SUBCASE("Handles hand back results and go stale once awaited") {
+        job_handle_t handle = job_create_handle([](zero_userdata_t data) -> zero_userdata_t {
+            job_yield();
+            return (zero_userdata_t)((intptr_t)data * 3);
+        }, (zero_userdata_t)14);
+        REQUIRE(handle.job);
+
+        zero_userdata_t result = nullptr;
+        REQUIRE(job_await(handle, &result) == JOB_WAIT_OK);
+        REQUIRE((intptr_t)result == 42);
+        REQUIRE(job_await(handle, &result) == -1);
+
+        int base = 20;
+        job_future_t<int> future = job_create_future([base]() {
+            job_yield();
+            return base + 1;
+        });
+        job_future_t<int> outer = job_create_future([future]() {
+            int inner = 0;
+            REQUIRE(job_await(future, &inner) == JOB_WAIT_OK);
+            return inner * 2;
+        });
+
+        int value = 0;
+        REQUIRE(job_await(outer, &value) == JOB_WAIT_OK);
+        REQUIRE(value == 42);
+
+        job_future_t<void> cancelled = job_create_future([]() {
+            while(job_yield() != JOB_WAIT_CANCELLED) {}
+        });
+        job_cancel(cancelled);
+        REQUIRE(job_await(cancelled) == JOB_WAIT_CANCELLED);
+
+        static ZERO_ATOMIC(int) released_ran;
+        released_ran = 0;
+        job_release(job_create_future([]() { released_ran = 1; }));
+        while(!ZERO_ATOMIC_LOAD(&released_ran)) {
+            jobs_run(latest_time);
+        }
+    }
+
+#if defined(__linux__)
+    SUBCASE("Jobs park on fds until epoll reports them ready") {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+        REQUIRE(job_fd_nonblocking(fds[0]) == 0);
+        REQUIRE(job_fd_nonblocking(fds[1]) == 0);
+
+        ZERO_ATOMIC(int) done = 0;
+        int read_fd = fds[0];
+        char received[16] = { 0 };
+        int timed_out = -1;
+
+        job_create([&]() {
+            timed_out = job_wait_fd(read_fd, JOB_IO_READ, 0.05);
+            REQUIRE(job_read(read_fd, received, sizeof(received)) == 5);
+        }, &done);
+
+        double time = latest_time;
+        for(int i = 0; i < 10; i++) {
+            jobs_run(time += 0.01);
+        }
+        REQUIRE(timed_out == JOB_WAIT_TIMED_OUT);
+        REQUIRE(done == 1);
+
+        std::thread writer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            REQUIRE(write(fds[1], "hello", 5) == 5);
+        });
+        // sleeps in epoll_wait until the writer's data arrives
+        jobs_run_until_idle();
+        writer.join();
+        REQUIRE(done == 0);
+        REQUIRE(std::string(received) == "hello");
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    SUBCASE("A reader and a writer wait on the same fd") {
+        int sv[2];
+        REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        REQUIRE(job_fd_nonblocking(sv[0]) == 0);
+        REQUIRE(job_fd_nonblocking(sv[1]) == 0);
+
+        ZERO_ATOMIC(int) done = 0;
+        char received[16] = { 0 };
+        int writable = -1;
+
+        job_create([&]() {
+            REQUIRE(job_read(sv[0], received, sizeof(received)) == 4);
+        }, &done);
+        jobs_run(latest_time);
+
+        // registers sv[0] for writing while the reader is parked on it
+        job_create([&]() {
+            writable = job_wait_fd(sv[0], JOB_IO_WRITE);
+            REQUIRE(write(sv[1], "ping", 4) == 4);
+        }, &done);
+
+        jobs_run_until_idle();
+        REQUIRE(done == 0);
+        REQUIRE(writable == JOB_WAIT_OK);
+        REQUIRE(std::string(received) == "ping");
+
+        close(sv[0]);
+        close(sv[1]);
+    }
+
+    SUBCASE("Loopback sockets echo through job_read and job_write") {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(listener >= 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        REQUIRE(bind(listener, (sockaddr*)&address, sizeof(address)) == 0);
+        REQUIRE(listen(listener, 16) == 0);
+        REQUIRE(getsockname(listener, (sockaddr*)&address, &length) == 0);
+        job_fd_nonblocking(listener);
+
+        const int clients = 8;
+        ZERO_ATOMIC(int) done = 0;
+        int echoed = 0;
+
+        job_create([&]() {
+            for(int accepted = 0; accepted < clients; ) {
+                int connection = accept(listener, NULL, NULL);
+                if(connection < 0) {
+                    REQUIRE(job_wait_fd(listener, JOB_IO_READ) == JOB_WAIT_OK);
+                    continue;
+                }
+                accepted++;
+                job_fd_nonblocking(connection);
+                job_create([connection]() {
+                    char buffer[64];
+                    intptr_t count;
+                    while((count = job_read(connection, buffer, sizeof(buffer))) > 0) {
+                        job_write(connection, buffer, (size_t)count);
+                    }
+                    close(connection);
+                }, nullptr);
+            }
+        }, &done);
+
+        for(int i = 0; i < clients; i++) {
+            job_create([&, i]() {
+                int client = socket(AF_INET, SOCK_STREAM, 0);
+                job_fd_nonblocking(client);
+                if(connect(client, (sockaddr*)&address, sizeof(address)) != 0) {
+                    REQUIRE(errno == EINPROGRESS);
+                    REQUIRE(job_wait_fd(client, JOB_IO_WRITE) == JOB_WAIT_OK);
+                }
+
+                std::string message = "client " + std::to_string(i);
+                REQUIRE(job_write(client, message.data(), message.size()) == (intptr_t)message.size());
+
+                std::string reply;
+                char buffer[64];
+                while(reply.size() < message.size()) {
+                    intptr_t count = job_read(client, buffer, sizeof(buffer));
+                    REQUIRE(count > 0);
+                    reply.append(buffer, (size_t)count);
+                }
+                REQUIRE(reply == message);
+                echoed++;
+                close(client);
+            }, &done);
+        }
+
+        jobs_run_until_idle();
+        REQUIRE(done == 0);
+        REQUIRE(echoed == clients);
+        close(listener);
+    }
+#endif
+
+    SUBCASE("Blocking calls run off the worker while its other jobs keep going") {
+        ZERO_ATOMIC(int) blocked = 0;
+        int results[4] = { 0 };
+        int ticks = 0;
+
+        for(int i = 0; i < 4; i++) {
+            job_create([&, i]() {
+                results[i] = job_run_blocking([i]() {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    return i + 100;
+                });
+            }, &blocked);
+        }
+        job_create([&]() {
+            while(ZERO_ATOMIC_LOAD(&blocked)) {
+                ticks++;
+                job_yield();
+            }
+        }, nullptr);
+
+        auto start = std::chrono::steady_clock::now();
+        jobs_run_until_idle();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        for(int i = 0; i < 4; i++) {
+            REQUIRE(results[i] == i + 100);
+        }
+        // the calls overlap on the blocking threads and the worker kept
+        // running its other job meanwhile
+        REQUIRE(elapsed < std::chrono::milliseconds(180));
+        REQUIRE(ticks > 10);
+
+        zero_userdata_t echoed = job_run_blocking([](zero_userdata_t data) { return data; }, (zero_userdata_t)7);
+        REQUIRE((intptr_t)echoed == 7);
+        jobs_blocking_stop();
+    }
+
+    SUBCASE("Job rings stay FIFO across wrapping and growth") {
+        job_t records[40];
+        job_ring_t ring;
+        ring.reserve(16);
+        REQUIRE(ring.capacity == 16);
+
+        // wrap the indices before growing
+        for(int i = 0; i < 10; i++) ring.push(&records[i]);
+        for(int i = 0; i < 10; i++) ring.pop();
+        for(int i = 0; i < 40; i++) ring.push(&records[i]);
+        REQUIRE(ring.capacity == 64);
+        REQUIRE(ring.size() == 40);
+        REQUIRE(ring.at(39) == &records[39]);
+
+        job_ring_t other;
+        other.swap(ring);
+        REQUIRE(ring.empty());
+        for(int i = 0; i < 40; i++) {
+            REQUIRE(other.front() == &records[i]);
+            other.pop();
+        }
+        REQUIRE(other.empty());
+    }
+
+    SUBCASE("Trimming hands idle stacks back and keeps the pool usable") {
+        static int touched = 0;
+        auto touch_stack = [](zero_userdata_t) -> zero_userdata_t {
+            volatile char buffer[32 * 1024];
+            buffer[0] = 1;
+            buffer[sizeof(buffer) - 1] = 1;
+            job_yield();
+            touched += buffer[0] + buffer[sizeof(buffer) - 1];
+            return NULL;
+        };
+
+        job_pool_stats_t before;
+        job_pool_stats(JOB_POOL_SMALL, &before);
+        REQUIRE(jobs_stack_backing(JOB_POOL_SMALL) == JOB_STACKS_MALLOC);
+        REQUIRE(jobs_stack_backing(JOB_POOL_INLINE) == JOB_STACKS_MALLOC);
+
+        ZERO_ATOMIC(int) burst = 0;
+        touched = 0;
+        for(int i = 0; i < 64; i++) job_create(touch_stack, &burst);
+        while(burst) jobs_run(0.0);
+        REQUIRE(touched == 128);
+
+        job_pool_stats_t stats;
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.capacity == ZERO_JOBS_SMALL_COUNT);
+        REQUIRE(stats.high_water >= 64);
+        REQUIRE(stats.in_use == before.in_use);
+
+        // the first trim still covers the burst, the second finds the
+        // pool idle since then
+        job_pool_trim();
+#if defined(__linux__)
+        REQUIRE(job_pool_trim() > 0);
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.resident == stats.in_use);
+#endif
+
+        touched = 0;
+        for(int i = 0; i < 8; i++) job_create(touch_stack, &burst);
+        while(burst) jobs_run(0.0);
+        REQUIRE(touched == 16);
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.high_water >= 64);
+    }
+
+    SUBCASE("Pools grow up to their limit and then hold callers back") {
+        jobs_config_t config = { 0 };
+        config.worker_count = 1;
+        config.pool_limits[JOB_POOL_SMALL] = 2 * ZERO_JOBS_SMALL_COUNT;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        static int finished = 0;
+        auto short_job = [](zero_userdata_t) -> zero_userdata_t {
+            for(int i = 0; i < 3; i++) job_yield();
+            finished++;
+            return NULL;
+        };
+
+        // three times the fixed pool, the last third only gets slots as
+        // the first jobs finish
+        ZERO_ATOMIC(int) done = 0;
+        const int count = 3 * ZERO_JOBS_SMALL_COUNT;
+        finished = 0;
+        for(int i = 0; i < count; i++) {
+            REQUIRE(job_create(short_job, &done) != NULL);
+        }
+
+        job_pool_stats_t stats;
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.limit == 2 * ZERO_JOBS_SMALL_COUNT);
+        REQUIRE(stats.capacity == stats.limit);
+        REQUIRE(stats.high_water == stats.limit);
+        REQUIRE(finished > 0);
+
+        while(done) jobs_run(0.0);
+        REQUIRE(finished == count);
+
+        // without a limit an exhausted pool hands back NULL again
+        config.pool_limits[JOB_POOL_SMALL] = 0;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        int created = 0;
+        while(job_create(short_job, &done)) created++;
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.capacity == 2 * ZERO_JOBS_SMALL_COUNT);
+        REQUIRE(stats.in_use == stats.capacity);
+        REQUIRE(created > ZERO_JOBS_SMALL_COUNT);
+
+        while(done) jobs_run(0.0);
+    }
+
+    SUBCASE("Callers outside of a job wait for a slot or give up") {
+        jobs_config_t config = { 0 };
+        config.worker_count = 1;
+        config.pool_limits[JOB_POOL_SMALL] = ZERO_JOBS_SMALL_COUNT;
+        config.pool_wait_timeout = -1.0;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        auto timer_job = [](zero_userdata_t data) -> zero_userdata_t {
+            job_wait((double)(intptr_t)data / 1000.0);
+            return NULL;
+        };
+
+        // a negative timeout doesn't wait
+        ZERO_ATOMIC(int) done = 0;
+        job_t *job;
+        while((job = job_create(timer_job, &done))) job->data = (zero_userdata_t)10;
+        job_pool_stats_t stats;
+        job_pool_stats(JOB_POOL_SMALL, &stats);
+        REQUIRE(stats.in_use == stats.capacity);
+
+        // the wait lets the timers of the jobs holding the pool fire
+        config.pool_wait_timeout = 0.0;
+        REQUIRE(jobs_configure(&config) == 0);
+        REQUIRE(job_create(timer_job, &done) != NULL);
+        while(done) jobs_run(latest_time + 0.01);
+
+        // a bounded wait gives up while the pool is held for longer
+        config.pool_wait_timeout = -1.0;
+        REQUIRE(jobs_configure(&config) == 0);
+        while((job = job_create(timer_job, &done))) job->data = (zero_userdata_t)10000;
+
+        config.pool_wait_timeout = 0.02;
+        REQUIRE(jobs_configure(&config) == 0);
+        double start = jobs_clock();
+        REQUIRE(job_create(timer_job, &done) == NULL);
+        REQUIRE(jobs_clock() - start >= 0.02);
+
+        while(done) jobs_run(latest_time + 1.0);
+        config.pool_limits[JOB_POOL_SMALL] = 0;
+        config.pool_wait_timeout = 0.0;
+        REQUIRE(jobs_configure(&config) == 0);
+    }
+
+    SUBCASE("Group waits outside of a job let their children's timers fire") {
+        static int woke = 0;
+        woke = 0;
+
+        job_group_t group;
+        job_group_init(&group);
+        job_group_create(&group, [](zero_userdata_t) -> zero_userdata_t {
+            job_wait(0.01);
+            woke = 1;
+            return NULL;
+        }, NULL);
+
+        REQUIRE(job_group_wait(&group) == JOB_WAIT_OK);
+        REQUIRE(woke == 1);
+    }
+
+    SUBCASE("Awaits outside of a job let the job's timers fire") {
+        job_handle_t handle = job_create_handle([](zero_userdata_t data) -> zero_userdata_t {
+            job_wait(0.01);
+            return data;
+        }, (zero_userdata_t)7);
+        REQUIRE(handle.job);
+
+        zero_userdata_t result = nullptr;
+        REQUIRE(job_await(handle, &result) == JOB_WAIT_OK);
+        REQUIRE((intptr_t)result == 7);
+    }
+
+    SUBCASE("Passes run by a wait don't end the caller's arena frame") {
+        jobs_config_t config = { 0 };
+        config.worker_count = 1;
+        config.arena_frame_per_run = 1;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        int *before = (int*)job_arena_alloc(sizeof(int), 16);
+        *before = 42;
+
+        job_group_t group;
+        job_group_init(&group);
+        job_group_create(&group, [](zero_userdata_t) -> zero_userdata_t {
+            for(int i = 0; i < ZERO_JOBS_ARENA_FRAMES + 2; i++) job_yield();
+            return NULL;
+        }, NULL);
+        REQUIRE(job_group_wait(&group) == JOB_WAIT_OK);
+
+        // still the same frame, so the next allocation follows on
+        int *after = (int*)job_arena_alloc(sizeof(int), 16);
+        REQUIRE((char*)after == (char*)before + 16);
+        REQUIRE(*before == 42);
+
+        config.arena_frame_per_run = 0;
+        REQUIRE(jobs_configure(&config) == 0);
     }
 
 //    Rockit::MutableArray<std::string> testArray(10);
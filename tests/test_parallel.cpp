@@ -0,0 +1,130 @@
+#include <doctest/doctest.h>
+#include <zero/zero_parallel.h>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// no default constructor, parallel_sort must not need one
+struct parallel_key_t {
+    explicit parallel_key_t(unsigned value) : value(value) {}
+    unsigned value;
+    bool operator<(const parallel_key_t &other) const { return value < other.value; }
+};
+
+TEST_CASE("Parallel algorithms") {
+    job_pool_init();
+
+    SUBCASE("parallel_invoke runs every function") {
+        int a = 0, b = 0, c = 0;
+        parallel_invoke([&]() { a = 1; },
+                        [&]() { b = 2; },
+                        [&]() { c = 3; });
+        REQUIRE(a == 1);
+        REQUIRE(b == 2);
+        REQUIRE(c == 3);
+
+        int only = 0;
+        parallel_invoke([&]() { only = 4; });
+        REQUIRE(only == 4);
+    }
+
+    SUBCASE("grain size gives every worker a few chunks") {
+        jobs_config_t config = { 0 };
+        config.worker_count = 2;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        const size_t count = 1 << 20;
+        REQUIRE(parallel_grain_size(count, 1) == count / (2 * ZERO_PARALLEL_CHUNKS_PER_WORKER));
+        REQUIRE(parallel_grain_size(count, count) == count);
+        REQUIRE(parallel_grain_size(0, 0) == 1);
+
+        config.worker_count = 1;
+        REQUIRE(jobs_configure(&config) == 0);
+    }
+
+    SUBCASE("chunks are spread over the workers") {
+        jobs_config_t config = { 0 };
+        config.worker_count = 2;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        ZERO_ATOMIC(int) entered = 0;
+        ZERO_ATOMIC(int) stop = 0;
+        std::thread worker([&]() {
+            jobs_worker_enter(1);
+            ZERO_ATOMIC_SWAP(&entered, 1);
+            jobs_run_until_idle(&stop);
+            jobs_worker_exit();
+        });
+        while(!ZERO_ATOMIC_LOAD(&entered)) std::this_thread::yield();
+
+        std::vector<int> ran_on(4096, -1);
+        parallel_transform(ran_on.begin(), ran_on.end(), ran_on.begin(), [](int) { return job_worker_index; }, 256);
+
+        std::vector<unsigned> values(20000);
+        unsigned state = 99;
+        for(auto &v : values) {
+            state = state * 1664525u + 1013904223u;
+            v = state >> 8;
+        }
+        parallel_sort(values.begin(), values.end(), std::less<unsigned>(), 512);
+
+        ZERO_ATOMIC_SWAP(&stop, 1);
+        jobs_wake(1);
+        worker.join();
+        config.worker_count = 1;
+        REQUIRE(jobs_configure(&config) == 0);
+
+        REQUIRE(std::count(ran_on.begin(), ran_on.end(), 0) > 0);
+        REQUIRE(std::count(ran_on.begin(), ran_on.end(), 1) > 0);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+    }
+
+    SUBCASE("output iterators must be forward iterators") {
+        REQUIRE(parallel_forward_output<int*>::value);
+        REQUIRE(parallel_forward_output<std::vector<int>::iterator>::value);
+        REQUIRE_FALSE(parallel_forward_output<std::back_insert_iterator<std::vector<int>>>::value);
+    }
+
+    SUBCASE("parallel_transform matches std::transform") {
+        std::vector<int> values(10000);
+        std::iota(values.begin(), values.end(), 0);
+        std::vector<int> doubled(values.size());
+
+        parallel_transform(values.begin(), values.end(), doubled.begin(), [](int v) { return v * 2; }, 256);
+
+        for(size_t i = 0; i < values.size(); i++) {
+            REQUIRE(doubled[i] == values[i] * 2);
+        }
+    }
+
+    SUBCASE("parallel_sort sorts") {
+        std::vector<unsigned> values(20000);
+        unsigned state = 12345;
+        for(auto &v : values) {
+            state = state * 1664525u + 1013904223u;
+            v = state >> 8;
+        }
+
+        parallel_sort(values.begin(), values.end(), std::less<unsigned>(), 512);
+        REQUIRE(std::is_sorted(values.begin(), values.end()));
+
+        parallel_sort(values.begin(), values.end(), std::greater<unsigned>());
+        REQUIRE(std::is_sorted(values.begin(), values.end(), std::greater<unsigned>()));
+
+        std::vector<parallel_key_t> keys;
+        for(unsigned v : values) keys.emplace_back(v);
+        parallel_sort(keys.begin(), keys.end(), std::less<parallel_key_t>(), 512);
+        REQUIRE(std::is_sorted(keys.begin(), keys.end()));
+    }
+
+    SUBCASE("parallel_scan matches std::partial_sum") {
+        std::vector<long long> values(10001);
+        std::iota(values.begin(), values.end(), 1);
+        std::vector<long long> expected(values.size());
+        std::vector<long long> scanned(values.size());
+        std::partial_sum(values.begin(), values.end(), expected.begin());
+
+        parallel_scan(values.begin(), values.end(), scanned.begin(), std::plus<long long>(), 300);
+        REQUIRE(scanned == expected);
+    }
+}
@@ -0,0 +1,53 @@
+#include <doctest/doctest.h>
+#include <zero/zero_profiler.h>
+#include <string.h>
+#include <time.h>
+
+static double profiler_cpu_seconds() {
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void *profiler_burn(void *data) {
+    double until = profiler_cpu_seconds() + 0.3;
+    volatile uint64_t sum = 0;
+    while(profiler_cpu_seconds() < until) {
+        for(int i = 0; i < 10000; i++) sum = sum + i;
+        zero_fiber_yield(data);
+    }
+    return nullptr;
+}
+
+TEST_CASE("Profiler") {
+    SUBCASE("Samples are attributed to the running fiber") {
+        zero_profiler_reset();
+        if(zero_profiler_start(1000) != 0) {
+            // not supported on this target
+            return;
+        }
+
+        zero_fiber_t *fiber = zero_fiber_make("burner", 64*1024, profiler_burn, nullptr);
+        while(zero_fiber_is_active(fiber)) {
+            zero_fiber_resume(fiber, nullptr);
+        }
+        zero_profiler_stop();
+        zero_fiber_delete(fiber);
+
+        REQUIRE(zero_profiler_sample_count() > 0);
+
+        FILE *folded = tmpfile();
+        REQUIRE(folded);
+        REQUIRE(zero_profiler_write_folded(folded) > 0);
+        rewind(folded);
+
+        int burner_lines = 0;
+        char line[4096];
+        while(fgets(line, sizeof(line), folded)) {
+            if(strncmp(line, "burner;", 7) == 0) burner_lines++;
+        }
+        fclose(folded);
+        REQUIRE(burner_lines > 0);
+
+        zero_profiler_reset();
+        REQUIRE(zero_profiler_sample_count() == 0);
+    }
+}
@@ -7,6 +7,12 @@
 #define ZERO_FIBER_IMPL
 #include <zero/zero_fiber.h>
 
+#define ZERO_JOBS_IMPL
+#include <zero/zero_jobs.h>
+
+#define ZERO_PROFILER_IMPL
+#include <zero/zero_profiler.h>
+
 TEST_CASE("main") {
 
 }